@@ -22,6 +22,8 @@
 #include "xdgenvironment.h"
 #include "xdgicontheme.h"
 #include "xdgiconmanager.h"
+#include "xdgiconhandle.h"
+#include "xdgiconprefetch.h"
 #include "xdgthemechooser.h"
 
 /**
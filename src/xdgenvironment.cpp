@@ -36,8 +36,59 @@ namespace
         QByteArray env = qgetenv(varName);
         return env.isEmpty() ? defValue : QString::fromLocal8Bit(env.constData(), env.size());
     }
+
+    /*
+      The environment is read once, it is not expected to change while the
+      application runs.
+    */
+    struct XdgPaths
+    {
+        XdgPaths();
+        QDir dataHome;
+        QDir configHome;
+        QDir cacheHome;
+        QDir runtimeDir;
+        QList<QDir> dataDirs;
+        QList<QDir> configDirs;
+    };
+
+    XdgPaths::XdgPaths()
+    {
+#ifdef Q_WS_WIN
+        dataHome = QDir(getValue("APPDATA", QDir::homePath()));
+        configHome = dataHome;
+        cacheHome = QDir(getValue("LOCALAPPDATA", dataHome.absolutePath()));
+        runtimeDir = QDir::temp();
+        dataDirs.append(QDir(QCoreApplication::applicationDirPath()));
+        configDirs.append(QDir(getValue("COMMON_APPDATA", QCoreApplication::applicationDirPath())));
+#elif defined(Q_WS_MAC)
+        dataHome = QDir(getValue("XDG_DATA_HOME",
+                                 QDir::home().absoluteFilePath(QLatin1String("Library/Preferences"))));
+        configHome = QDir(getValue("XDG_CONFIG_HOME",
+                                   QDir::home().absoluteFilePath(QLatin1String("Library/Preferences"))));
+        cacheHome = QDir(getValue("XDG_CACHE_HOME",
+                                  QDir::home().absoluteFilePath(QLatin1String("Library/Caches"))));
+        runtimeDir = QDir(getValue("XDG_RUNTIME_DIR", QDir::tempPath()));
+        dataDirs.append(QDir(QCoreApplication::applicationDirPath()));
+        configDirs.append(QDir(QLatin1String("/Library/Preferences")));
+#else
+        dataHome = QDir(getValue("XDG_DATA_HOME",
+                                 QDir::home().absoluteFilePath(QLatin1String(".local/share"))));
+        configHome = QDir(getValue("XDG_CONFIG_HOME",
+                                   QDir::home().absoluteFilePath(QLatin1String(".config"))));
+        cacheHome = QDir(getValue("XDG_CACHE_HOME",
+                                  QDir::home().absoluteFilePath(QLatin1String(".cache"))));
+        runtimeDir = QDir(getValue("XDG_RUNTIME_DIR", QDir::tempPath()));
+        dataDirs = splitDirList(getValue("XDG_DATA_DIRS",
+                                         QLatin1String("/usr/local/share:/usr/share")));
+        configDirs = splitDirList(getValue("XDG_CONFIG_DIRS",
+                                           QDir::home().absoluteFilePath(QLatin1String("/etc/xdg"))));
+#endif
+    }
 }
 
+Q_GLOBAL_STATIC(XdgPaths, xdgPaths)
+
 XdgEnvironment::XdgEnvironment()
 {
 }
@@ -55,18 +106,13 @@ XdgEnvironment::~XdgEnvironment()
     otherwise <code>$HOME/Library/Preferences</code>.
   @arg Unix: Returns <code>$XDG_DATA_HOME</code> if the variable exists,
     otherwise <code>$HOME/.local/share</code>.
+
+  Like all directories returned by this class, it is determined on the
+  first call.
 */
 QDir XdgEnvironment::dataHome()
 {
-#ifdef Q_WS_WIN
-    return QDir(getValue("APPDATA", QDir::homePath()));
-#elif defined(Q_WS_MAC)
-    return QDir(getValue("XDG_DATA_HOME",
-                         QDir::home().absoluteFilePath(QLatin1String("Library/Preferences"))));
-#else
-    return QDir(getValue("XDG_DATA_HOME",
-                         QDir::home().absoluteFilePath(QLatin1String(".local/share"))));
-#endif
+    return xdgPaths()->dataHome;
 }
 
 /**
@@ -82,15 +128,35 @@ QDir XdgEnvironment::dataHome()
 */
 QDir XdgEnvironment::configHome()
 {
-#ifdef Q_WS_WIN
-    return QDir(getValue("APPDATA", QDir::homePath()));
-#elif defined(Q_WS_MAC)
-    return QDir(getValue("XDG_CONFIG_HOME",
-                         QDir::home().absoluteFilePath(QLatin1String("Library/Preferences"))));
-#else
-    return QDir(getValue("XDG_CONFIG_HOME",
-                         QDir::home().absoluteFilePath(QLatin1String(".config"))));
-#endif
+    return xdgPaths()->configHome;
+}
+
+/**
+  Returns the directory for per-user non-essential (cached) data.
+
+  @arg Windows: Returns <code>\%LOCALAPPDATA\%</code> if the variable
+    exists, otherwise the same as <code>dataHome()</code>.
+  @arg Mac: Returns <code>$XDG_CACHE_HOME</code> if the variable exists,
+    otherwise <code>$HOME/Library/Caches</code>.
+  @arg Unix: Returns <code>$XDG_CACHE_HOME</code> if the variable exists,
+    otherwise <code>$HOME/.cache</code>.
+*/
+QDir XdgEnvironment::cacheHome()
+{
+    return xdgPaths()->cacheHome;
+}
+
+/**
+  Returns the directory for per-user runtime files, which usually lives on
+  a memory file system and is emptied when the user logs out.
+
+  @arg Windows: Returns the temporary directory.
+  @arg Mac and Unix: Returns <code>$XDG_RUNTIME_DIR</code> if the variable
+    exists, otherwise the temporary directory.
+*/
+QDir XdgEnvironment::runtimeDir()
+{
+    return xdgPaths()->runtimeDir;
 }
 
 /**
@@ -104,14 +170,7 @@ QDir XdgEnvironment::configHome()
 */
 QList<QDir> XdgEnvironment::dataDirs()
 {
-#if defined(Q_WS_WIN) || defined (Q_WS_MAC)
-    QList<QDir> list;
-    list.append(QDir(QCoreApplication::applicationDirPath()));
-    return list;
-#else
-    return splitDirList(getValue("XDG_DATA_DIRS",
-                                 QLatin1String("/usr/local/share:/usr/share")));
-#endif
+    return xdgPaths()->dataDirs;
 }
 
 /**
@@ -125,16 +184,5 @@ QList<QDir> XdgEnvironment::dataDirs()
 */
 QList<QDir> XdgEnvironment::configDirs()
 {
-#ifdef Q_WS_WIN
-    QList<QDir> list;
-    list.append(QDir(getValue("COMMON_APPDATA", QCoreApplication::applicationDirPath())));
-    return list;
-#elif defined(Q_WS_MAC)
-    QList<QDir> list;
-    list.append(QDir(QLatin1String("/Library/Preferences")));
-    return list;
-#else
-    return splitDirList(getValue("XDG_CONFIG_DIRS",
-                                 QDir::home().absoluteFilePath(QLatin1String("/etc/xdg"))));
-#endif
+    return xdgPaths()->configDirs;
 }
@@ -37,6 +37,8 @@ class XDG_API XdgEnvironment
 public:
     static QDir dataHome();
     static QDir configHome();
+    static QDir cacheHome();
+    static QDir runtimeDir();
     static QList<QDir> dataDirs();
     static QList<QDir> configDirs();
 private:
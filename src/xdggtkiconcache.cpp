@@ -0,0 +1,236 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <string.h>
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+#include <QtCore/QVector>
+#include <QtCore/QtEndian>
+#include "xdggtkiconcache_p.h"
+#include "xdgiconindex_p.h"
+#include "xdgicontheme_p.h"
+
+namespace
+{
+	// See docs/iconcache.txt in the GTK+ sources
+	const quint16 cacheMajorVersion = 1;
+	const quint32 noOffset = 0xffffffff;
+	enum ImageFlag
+	{
+		HasSuffixXpm = 1,
+		HasSuffixSvg = 2,
+		HasSuffixPng = 4,
+		HasIconFile = 8
+	};
+
+	struct ImageSuffix
+	{
+		ImageFlag flag;
+		const char *suffix;
+	};
+
+	// Same priority as the extensions list of XdgIconThemePrivate, which
+	// also has compressed SVG files the cache can't describe
+	const ImageSuffix suffixes[] = {
+		{ HasSuffixPng, ".png" },
+		{ HasSuffixSvg, ".svg" },
+		{ HasSuffixXpm, ".xpm" }
+	};
+	const int suffixCount = sizeof(suffixes) / sizeof(ImageSuffix);
+
+	struct CacheEntry
+	{
+		QString name;
+		const XdgIconDir *dir;
+		QString path;
+	};
+}
+
+XdgGtkIconCache::XdgGtkIconCache() : m_data(0), m_size(0)
+{
+}
+
+XdgGtkIconCache::~XdgGtkIconCache()
+{
+	clear();
+}
+
+/**
+  Checks whether the theme directory has an <code>icon-theme.cache</code>.
+  Like GTK+ does, the cache is considered stale if it is older than the
+  directory itself; dirs changed later are found by <code>staleDirs()</code>.
+*/
+bool XdgGtkIconCache::isUpToDate(const QDir &themeDir)
+{
+	QFileInfo info(themeDir.filePath(QLatin1String("icon-theme.cache")));
+	return info.exists() && info.lastModified() >= QFileInfo(themeDir.absolutePath()).lastModified();
+}
+
+/**
+  Maps <code>icon-theme.cache</code> of the theme directory if it is up to
+  date.
+*/
+bool XdgGtkIconCache::load(const QDir &themeDir)
+{
+	clear();
+	if (!isUpToDate(themeDir))
+		return false;
+	m_file.setFileName(themeDir.filePath(QLatin1String("icon-theme.cache")));
+	if (!m_file.open(QIODevice::ReadOnly))
+		return false;
+	m_modified = QFileInfo(m_file).lastModified();
+	qint64 size = m_file.size();
+	if (size >= 12 && size < qint64(noOffset))
+		m_data = m_file.map(0, size);
+	m_size = m_data ? quint32(size) : 0;
+	quint16 major = 0;
+	if (!readCard16(0, &major) || major != cacheMajorVersion) {
+		clear();
+		return false;
+	}
+	return true;
+}
+
+/**
+  Returns the dirs of the theme which were modified after the cache was
+  written, like GTK+ checks them: a package may add icons there without
+  updating the cache, which only changes the time of the dir itself. A
+  dir modified in the same second as the cache is counted as stale too.
+*/
+QList<const XdgIconDir *> XdgGtkIconCache::staleDirs(const XdgIconDirList &subdirs, const QDir &themeDir) const
+{
+	QList<const XdgIconDir *> stale;
+	foreach (const XdgIconDir &subdir, subdirs) {
+		QFileInfo info(themeDir.filePath(subdir.path));
+		if (info.exists() && info.lastModified() >= m_modified)
+			stale << &subdir;
+	}
+	return stale;
+}
+
+/**
+  Adds every image listed in the cache to the builder, except those of the
+  dirs to skip. Nothing is added if the cache turns out to be corrupted, so
+  the caller can safely fall back to the directory scan. Compressed SVG
+  files are not in the cache, so they are not added.
+*/
+bool XdgGtkIconCache::fill(XdgIconIndexBuilder &builder, int basedir, const XdgIconDirList &subdirs,
+                           const QDir &themeDir, const QList<const XdgIconDir *> &skip) const
+{
+	quint32 hashOffset = 0, dirListOffset = 0, dirCount = 0, bucketCount = 0;
+	if (!readCard32(4, &hashOffset) || !readCard32(8, &dirListOffset)
+	        || !readCard32(dirListOffset, &dirCount) || !readCard32(hashOffset, &bucketCount)
+	        || quint64(dirCount) * 4 > m_size || quint64(bucketCount) * 4 > m_size)
+		return false;
+
+	QVector<const XdgIconDir *> dirs(dirCount);
+	QVector<QString> prefixes(dirCount);
+	for (quint32 i = 0; i < dirCount; i++) {
+		quint32 offset = 0;
+		const char *str = readCard32(dirListOffset + 4 + i * 4, &offset) ? readString(offset) : 0;
+		if (!str)
+			return false;
+		QString dirName = QString::fromUtf8(str);
+		dirs[i] = xdgFindIconDir(subdirs, dirName);
+		if (skip.contains(dirs.at(i)))
+			dirs[i] = 0;
+		if (!dirs.at(i))
+			continue;
+		prefixes[i] = themeDir.absoluteFilePath(dirName) + QLatin1Char('/');
+	}
+
+	// Every icon record takes 12 bytes, so there can't be more of them
+	quint32 steps = m_size / 12;
+	QList<CacheEntry> entries;
+	for (quint32 i = 0; i < bucketCount; i++) {
+		quint32 iconOffset = noOffset;
+		if (!readCard32(hashOffset + 4 + i * 4, &iconOffset))
+			return false;
+		while (iconOffset != noOffset) {
+			quint32 chainOffset = 0, nameOffset = 0, listOffset = 0, imageCount = 0;
+			if (!steps-- || !readCard32(iconOffset, &chainOffset)
+			        || !readCard32(iconOffset + 4, &nameOffset)
+			        || !readCard32(iconOffset + 8, &listOffset)
+			        || !readCard32(listOffset, &imageCount))
+				return false;
+			const char *str = readString(nameOffset);
+			if (!str)
+				return false;
+			// GTK+ strips only the last suffix, the scanner uses QFileInfo::baseName()
+			QString fileName = QString::fromUtf8(str);
+			QString name = fileName.section(QLatin1Char('.'), 0, 0);
+			for (quint32 j = 0; j < imageCount; j++) {
+				quint16 dirIndex = 0, flags = 0;
+				if (!readCard16(listOffset + 4 + j * 8, &dirIndex)
+				        || !readCard16(listOffset + 6 + j * 8, &flags))
+					return false;
+				if (dirIndex >= dirCount || !dirs.at(dirIndex))
+					continue;
+				for (int k = 0; k < suffixCount; k++) {
+					if (!(flags & suffixes[k].flag))
+						continue;
+					CacheEntry entry;
+					entry.name = name;
+					entry.dir = dirs.at(dirIndex);
+					entry.path = prefixes.at(dirIndex) + fileName + QLatin1String(suffixes[k].suffix);
+					entries.append(entry);
+				}
+			}
+			iconOffset = chainOffset;
+		}
+	}
+
+	foreach (const CacheEntry &entry, entries)
+		builder.addEntry(entry.name, basedir, entry.dir, entry.path);
+	return true;
+}
+
+void XdgGtkIconCache::clear()
+{
+	if (m_data) {
+		m_file.unmap(m_data);
+		m_data = 0;
+	}
+	if (m_file.isOpen())
+		m_file.close();
+	m_size = 0;
+	m_modified = QDateTime();
+}
+
+bool XdgGtkIconCache::readCard16(quint32 offset, quint16 *value) const
+{
+	if (quint64(offset) + 2 > m_size)
+		return false;
+	*value = qFromBigEndian<quint16>(m_data + offset);
+	return true;
+}
+
+bool XdgGtkIconCache::readCard32(quint32 offset, quint32 *value) const
+{
+	if (quint64(offset) + 4 > m_size)
+		return false;
+	*value = qFromBigEndian<quint32>(m_data + offset);
+	return true;
+}
+
+const char *XdgGtkIconCache::readString(quint32 offset) const
+{
+	if (offset >= m_size || !memchr(m_data + offset, '\0', m_size - offset))
+		return 0;
+	return reinterpret_cast<const char *>(m_data + offset);
+}
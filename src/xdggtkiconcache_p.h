@@ -0,0 +1,63 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef XDGGTKICONCACHE_P_H
+#define XDGGTKICONCACHE_P_H
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include "xdgiconindex_p.h"
+
+/**
+  @private
+
+  Reader for the <code>icon-theme.cache</code> files generated by
+  <code>gtk-update-icon-cache</code>. The file is memory-mapped and its
+  contents are fed to <code>XdgIconIndexBuilder</code> instead of walking
+  the theme directory.
+
+  The format knows PNG, SVG and XPM images only, so compressed SVG files
+  (<code>.svgz</code>, <code>.svg.gz</code>) have to be listed by the
+  caller.
+*/
+class XdgGtkIconCache
+{
+	Q_DISABLE_COPY(XdgGtkIconCache)
+public:
+	XdgGtkIconCache();
+	~XdgGtkIconCache();
+
+	static bool isUpToDate(const QDir &themeDir);
+	bool load(const QDir &themeDir);
+	bool fill(XdgIconIndexBuilder &builder, int basedir, const XdgIconDirList &subdirs, const QDir &themeDir,
+	          const QList<const XdgIconDir *> &skip = QList<const XdgIconDir *>()) const;
+	QList<const XdgIconDir *> staleDirs(const XdgIconDirList &subdirs, const QDir &themeDir) const;
+	void clear();
+
+private:
+	bool readCard16(quint32 offset, quint16 *value) const;
+	bool readCard32(quint32 offset, quint32 *value) const;
+	const char *readString(quint32 offset) const;
+	QFile m_file;
+	QDateTime m_modified;
+	uchar *m_data;
+	quint32 m_size;
+};
+
+#endif // XDGGTKICONCACHE_P_H
@@ -18,6 +18,7 @@
 
 #include "xdgicon.h"
 #include "xdgiconengine_p.h"
+#include "xdgiconpixmapcache_p.h"
 #include "xdgicontheme_p.h"
 
 /**
@@ -30,6 +31,15 @@ XdgIcon::XdgIcon(const QString &id, const QString &theme, const XdgIconManager *
 {
 }
 
+/**
+  Creates an icon for a handle obtained from <code>XdgIconManager</code> or
+  <code>XdgIconTheme</code>. The icon shares the handle's lookup result.
+*/
+XdgIcon::XdgIcon(const XdgIconHandle &handle)
+        : QIcon(new XdgIconEngine(handle))
+{
+}
+
 /**
   Creates a copy of the specified <code>QIcon</code> with no special properties.
 */
@@ -55,3 +65,36 @@ XdgIcon &XdgIcon::operator =(const XdgIcon &other)
     }
     return *this;
 }
+
+/**
+  Sets the size of the icon pixmap cache in kilobytes, 10240 by default.
+  Must be called from the GUI thread, like the other cache functions.
+*/
+void XdgIcon::setCacheLimit(int kilobytes)
+{
+    XdgIconPixmapCache::instance()->setLimit(kilobytes);
+}
+
+/**
+  Returns the size of the icon pixmap cache in kilobytes.
+*/
+int XdgIcon::cacheLimit()
+{
+    return XdgIconPixmapCache::instance()->limit();
+}
+
+/**
+  Drops all pixmaps from the icon pixmap cache.
+*/
+void XdgIcon::clearCache()
+{
+    XdgIconPixmapCache::instance()->clear();
+}
+
+/**
+  Returns the counters of the icon pixmap cache since the start.
+*/
+XdgIcon::CacheStatistics XdgIcon::cacheStatistics()
+{
+    return XdgIconPixmapCache::instance()->statistics();
+}
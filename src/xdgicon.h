@@ -23,6 +23,7 @@
 #include "xdgexport.h"
 
 class XdgIconManager;
+class XdgIconHandle;
 
 /**
   @brief <code>QIcon</code> implementation backed by a theme
@@ -30,16 +31,36 @@ class XdgIconManager;
   An implementation of <code>QIcon</code> used by Q-XDG to retrieve icons
   based on a certain theme. Creating an instance of this class is equivalent
   to calling <code>XdgIconTheme::getIcon()</code>.
+
+  The pixmaps of all such icons are kept in a cache of their own, see
+  <code>setCacheLimit()</code>.
 */
 class XDG_API XdgIcon : public QIcon
 {
 public:
+    /**
+      Counters of the icon pixmap cache, see <code>cacheStatistics()</code>.
+    */
+    struct CacheStatistics
+    {
+        quint64 hits;       ///< Lookups which found the pixmap
+        quint64 misses;     ///< Pixmaps which had to be made
+        quint64 evictions;  ///< Pixmaps dropped to stay within the limit
+        int cost;           ///< Kilobytes held by the cache
+    };
+
     XdgIcon(const QString &id, const QString &theme, const XdgIconManager *manager);
+    XdgIcon(const XdgIconHandle &handle);
     XdgIcon(const QIcon &other);
     XdgIcon();
     ~XdgIcon();
 
     XdgIcon &operator =(const XdgIcon &other);
+
+    static void setCacheLimit(int kilobytes);
+    static int cacheLimit();
+    static void clearCache();
+    static CacheStatistics cacheStatistics();
 };
 
 #endif // XDGICON_H
@@ -0,0 +1,88 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include <QtCore/QFile>
+#include "xdgiconcachelock_p.h"
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// How often a waiting process checks the lock again, in milliseconds
+	const int pollInterval = 20;
+}
+
+XdgIconCacheLock::XdgIconCacheLock(const QString &path)
+	: m_path(QFile::encodeName(path)), m_fd(-1)
+{
+}
+
+XdgIconCacheLock::~XdgIconCacheLock()
+{
+	unlock();
+}
+
+/**
+  Takes the lock, waiting at most <code>timeout</code> milliseconds for
+  another process to release it. Returns false if it is still held then,
+  or the lock file can't be created.
+*/
+bool XdgIconCacheLock::lock(int timeout)
+{
+#ifdef Q_OS_UNIX
+	if (m_fd >= 0)
+		return true;
+	int fd = ::open(m_path.constData(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return false;
+	::fcntl(fd, F_SETFD, FD_CLOEXEC);
+	// flock() locks belong to the open file, so they exclude other
+	// threads of this process too, unlike fcntl() record locks
+	for (int waited = 0; ; waited += pollInterval) {
+		if (::flock(fd, LOCK_EX | LOCK_NB) == 0) {
+			m_fd = fd;
+			return true;
+		}
+		if ((errno != EWOULDBLOCK && errno != EINTR) || waited >= timeout)
+			break;
+		::usleep(pollInterval * 1000);
+	}
+	::close(fd);
+	return false;
+#else
+	Q_UNUSED(timeout);
+	return true;
+#endif
+}
+
+void XdgIconCacheLock::unlock()
+{
+#ifdef Q_OS_UNIX
+	if (m_fd < 0)
+		return;
+	// Closing the file releases the lock
+	::close(m_fd);
+	m_fd = -1;
+#endif
+}
@@ -0,0 +1,53 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef XDGICONCACHELOCK_P_H
+#define XDGICONCACHELOCK_P_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+/**
+  @private
+
+  Advisory lock on a cache file, shared by all processes of the user.
+  Processes started together would otherwise all rebuild the same stale
+  cache; with the lock only one of them scans, the others wait for it and
+  read what it wrote. The lock is a separate file next to the cache, which
+  is never removed, and is released by the kernel if its holder dies.
+
+  Where advisory locks are not available <code>lock()</code> always
+  succeeds without locking anything.
+*/
+class XdgIconCacheLock
+{
+public:
+	explicit XdgIconCacheLock(const QString &path);
+	~XdgIconCacheLock();
+
+	bool lock(int timeout);
+	void unlock();
+
+private:
+	Q_DISABLE_COPY(XdgIconCacheLock)
+	QByteArray m_path;
+	int m_fd;
+};
+
+#endif // XDGICONCACHELOCK_P_H
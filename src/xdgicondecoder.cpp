@@ -0,0 +1,337 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QPointer>
+#include <QtCore/QRunnable>
+#include <QtCore/QSet>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+#include <QtGui/QApplication>
+#include <QtGui/QImageReader>
+#include <QtGui/QPixmap>
+#include <QtGui/QStyle>
+#include <QtGui/QStyleOption>
+#include "xdgicondecoder_p.h"
+#include "xdgiconmanager.h"
+
+namespace
+{
+	// Icons are small, more threads would only compete for the disk
+	const int maxDecodes = 4;
+
+	// Shared by a pending decode and its job, which skips canceled ones
+	class DecodeState : public QSharedData
+	{
+	public:
+		DecodeState() : canceled(0) {}
+		QAtomicInt canceled;
+	};
+	typedef QExplicitlySharedDataPointer<DecodeState> DecodeStateRef;
+
+	/*
+	  A request for the pixmap of a file: a manager to tell about the icon
+	  name, or a prefetch to count it for.
+	*/
+	struct Waiter
+	{
+		QPointer<XdgIconManager> manager;
+		QString name;
+		XdgIconPixmapKey key;
+		QExplicitlySharedDataPointer<XdgIconPrefetchData> prefetch;
+	};
+
+	struct Decode
+	{
+		QString path;
+		DecodeStateRef state;
+		QList<Waiter> waiters;
+	};
+
+	struct Decoded
+	{
+		XdgIconFileKey file;
+		DecodeStateRef state;
+		QImage image;
+	};
+}
+
+/*
+  Lives in the GUI thread: requests come from paint code, and decoded
+  images are handed back to it through a queued call, like loaded themes
+  to XdgIconManager.
+*/
+class XdgIconDecodeQueue : public QObject
+{
+	Q_OBJECT
+public:
+	XdgIconDecodeQueue();
+	~XdgIconDecodeQueue();
+
+	void request(const QString &path, const XdgIconFileKey &file, const Waiter &waiter);
+	void cancel(XdgIconPrefetchData *prefetch);
+	void waitFor(const XdgIconPrefetchData *prefetch);
+	void finished(const Decoded &decoded);
+
+private slots:
+	void deliver();
+
+private:
+	QThreadPool m_pool;
+	QHash<XdgIconFileKey, Decode> m_pending;
+	QMutex m_doneLock;
+	QWaitCondition m_doneCondition;
+	QList<Decoded> m_done;
+};
+
+Q_GLOBAL_STATIC(XdgIconDecodeQueue, decodeQueue)
+
+namespace
+{
+	class DecodeJob : public QRunnable
+	{
+	public:
+		DecodeJob(XdgIconDecodeQueue *queue, const QString &path, const XdgIconFileKey &file, const DecodeStateRef &state)
+			: m_queue(queue), m_path(path)
+		{
+			m_decoded.file = file;
+			m_decoded.state = state;
+		}
+
+		void run()
+		{
+			if (!int(m_decoded.state->canceled))
+				m_decoded.image = XdgIconDecoder::decode(m_path, m_decoded.file.size);
+			m_queue->finished(m_decoded);
+		}
+
+	private:
+		XdgIconDecodeQueue *m_queue;
+		QString m_path;
+		Decoded m_decoded;
+	};
+}
+
+XdgIconDecodeQueue::XdgIconDecodeQueue()
+{
+	m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), maxDecodes));
+}
+
+XdgIconDecodeQueue::~XdgIconDecodeQueue()
+{
+	m_pool.waitForDone();
+}
+
+void XdgIconDecodeQueue::request(const QString &path, const XdgIconFileKey &file, const Waiter &waiter)
+{
+	QHash<XdgIconFileKey, Decode>::iterator it = m_pending.find(file);
+	if (it != m_pending.end() && int(it->state->canceled)) {
+		// Its job may have skipped it already, that result is dropped
+		m_pending.erase(it);
+		it = m_pending.end();
+	}
+	if (it == m_pending.end()) {
+		it = m_pending.insert(file, Decode());
+		it->path = path;
+		it->state = new DecodeState;
+		m_pool.start(new DecodeJob(this, path, file, it->state));
+	}
+	// The icon is painted over and over until it is ready
+	bool counted = false;
+	foreach (const Waiter &other, it->waiters) {
+		if (other.prefetch != waiter.prefetch)
+			continue;
+		if (other.key == waiter.key && other.manager == waiter.manager)
+			return;
+		counted = true;
+	}
+	if (waiter.prefetch && !counted)
+		waiter.prefetch->remaining++;
+	it->waiters << waiter;
+}
+
+/*
+  Forgets the prefetch's requests. Decodes nobody else waits for are
+  skipped if they didn't start yet.
+*/
+void XdgIconDecodeQueue::cancel(XdgIconPrefetchData *prefetch)
+{
+	QHash<XdgIconFileKey, Decode>::iterator it;
+	for (it = m_pending.begin(); it != m_pending.end(); ++it) {
+		QList<Waiter> &waiters = it->waiters;
+		for (int i = waiters.size() - 1; i >= 0; i--) {
+			if (waiters.at(i).prefetch.data() == prefetch)
+				waiters.removeAt(i);
+		}
+		if (waiters.isEmpty())
+			it->state->canceled = 1;
+	}
+	prefetch->remaining = 0;
+	prefetch->canceled = true;
+}
+
+/*
+  Delivers decoded images until the prefetch is complete. The event loop
+  is blocked meanwhile, so the queued deliveries can't be waited for.
+*/
+void XdgIconDecodeQueue::waitFor(const XdgIconPrefetchData *prefetch)
+{
+	while (prefetch->remaining > 0) {
+		m_doneLock.lock();
+		while (m_done.isEmpty())
+			m_doneCondition.wait(&m_doneLock);
+		m_doneLock.unlock();
+		deliver();
+	}
+}
+
+// Called by the worker threads
+void XdgIconDecodeQueue::finished(const Decoded &decoded)
+{
+	QMutexLocker locker(&m_doneLock);
+	m_done << decoded;
+	m_doneCondition.wakeAll();
+	if (m_done.size() == 1)
+		QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+
+/*
+  Files which could not be read are not announced, views would repaint
+  and ask for them again and again.
+*/
+void XdgIconDecodeQueue::deliver()
+{
+	m_doneLock.lock();
+	QList<Decoded> done = m_done;
+	m_done.clear();
+	m_doneLock.unlock();
+	XdgIconPixmapCache *cache = XdgIconPixmapCache::instance();
+	foreach (const Decoded &decoded, done) {
+		QHash<XdgIconFileKey, Decode>::iterator it = m_pending.find(decoded.file);
+		if (it == m_pending.end() || it->state != decoded.state)
+			continue;
+		QList<Waiter> waiters = it->waiters;
+		m_pending.erase(it);
+		QPixmap pixmap = QPixmap::fromImage(decoded.image);
+		QSet<XdgIconPrefetchData *> prefetches;
+		foreach (const Waiter &waiter, waiters) {
+			if (!pixmap.isNull())
+				cache->insert(waiter.key, decoded.file, pixmap);
+			if (waiter.prefetch) {
+				if (!pixmap.isNull())
+					XdgIconDecoder::generateModes(waiter.key, decoded.file, pixmap, waiter.prefetch->modes);
+				prefetches.insert(waiter.prefetch.data());
+			}
+		}
+		foreach (XdgIconPrefetchData *prefetch, prefetches)
+			prefetch->remaining--;
+		if (pixmap.isNull())
+			continue;
+		foreach (const Waiter &waiter, waiters) {
+			if (waiter.manager)
+				emit waiter.manager->iconDecoded(waiter.name, waiter.key.size);
+		}
+	}
+}
+
+/**
+  Reads the file scaled to a square of the size. Safe to call from any
+  thread.
+*/
+QImage XdgIconDecoder::decode(const QString &path, uint size)
+{
+	QImage image;
+	QImageReader reader;
+	reader.setFileName(path);
+	QSize minSize(size, size);
+	reader.setScaledSize(minSize);
+	reader.read(&image);
+	if (!image.isNull() && image.size() != minSize)
+		image = image.scaled(minSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	return image;
+}
+
+/**
+  Queues the file for decoding, as normal pixmap of the key, and remembers
+  to tell the manager about the icon name. Must be called from the GUI
+  thread, like all of the queue functions.
+*/
+void XdgIconDecoder::request(const QString &path, const XdgIconFileKey &file, const XdgIconPixmapKey &key,
+                             const XdgIconManager *manager, const QString &name)
+{
+	Waiter waiter;
+	waiter.manager = const_cast<XdgIconManager *>(manager);
+	waiter.name = name;
+	waiter.key = key;
+	decodeQueue()->request(path, file, waiter);
+}
+
+/**
+  Queues the file for decoding on behalf of the prefetch, which also gets
+  the pixmaps of its modes made once it is ready.
+*/
+void XdgIconDecoder::prefetch(const QString &path, const XdgIconFileKey &file, const XdgIconPixmapKey &key,
+                              XdgIconPrefetchData *prefetch)
+{
+	Waiter waiter;
+	waiter.key = key;
+	waiter.prefetch = prefetch;
+	decodeQueue()->request(path, file, waiter);
+}
+
+void XdgIconDecoder::cancel(XdgIconPrefetchData *prefetch)
+{
+	decodeQueue()->cancel(prefetch);
+}
+
+void XdgIconDecoder::waitFor(const XdgIconPrefetchData *prefetch)
+{
+	decodeQueue()->waitFor(prefetch);
+}
+
+/**
+  Caches the pixmaps of the other modes for a normal pixmap, as
+  <code>XdgIconEngine::pixmap()</code> would make them.
+*/
+void XdgIconDecoder::generateModes(const XdgIconPixmapKey &key, const XdgIconFileKey &file, const QPixmap &pixmap,
+                                   const QList<QIcon::Mode> &modes)
+{
+	XdgIconPixmapCache *cache = XdgIconPixmapCache::instance();
+	QStyleOption opt(0);
+	opt.palette = QApplication::palette();
+	XdgIconPixmapKey modeKey = key;
+	XdgIconFileKey modeFile = file;
+	modeKey.palette = modeFile.palette = opt.palette.cacheKey();
+	foreach (QIcon::Mode mode, modes) {
+		if (mode == QIcon::Normal)
+			continue;
+		modeKey.mode = modeFile.mode = mode;
+		QPixmap generated;
+		if (!cache->find(modeFile, &generated)) {
+			generated = QApplication::style()->generatedIconPixmap(mode, pixmap, &opt);
+			if (generated.isNull())
+				generated = pixmap;
+		}
+		cache->insert(modeKey, modeFile, generated);
+	}
+}
+
+#include "xdgicondecoder.moc"
@@ -0,0 +1,71 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef XDGICONDECODER_P_H
+#define XDGICONDECODER_P_H
+
+#include <QtCore/QSharedData>
+#include <QtGui/QIcon>
+#include <QtGui/QImage>
+#include "xdgiconpixmapcache_p.h"
+
+class XdgIconManager;
+
+/**
+  @private
+
+  State of an <code>XdgIconPrefetch</code>, only used in the GUI thread.
+  <code>remaining</code> counts the files which are still being decoded
+  for it.
+*/
+class XdgIconPrefetchData : public QSharedData
+{
+public:
+	XdgIconPrefetchData() : remaining(0), canceled(false) {}
+	QList<QIcon::Mode> modes;
+	int remaining;
+	bool canceled;
+};
+
+/**
+  @private
+
+  Reads icon files into images. <code>decode()</code> does it at once,
+  <code>request()</code> and <code>prefetch()</code> queue the file for a
+  pool of worker threads, which never run more than a few decodes at a
+  time. Requests for a file which is being decoded already only add their
+  key to it. The pixmap is made and put into the pixmap cache in the GUI
+  thread, under the keys of all requests, and then every manager which
+  asked for it emits <code>iconDecoded()</code>.
+*/
+class XdgIconDecoder
+{
+public:
+	static QImage decode(const QString &path, uint size);
+	static void request(const QString &path, const XdgIconFileKey &file, const XdgIconPixmapKey &key,
+	                    const XdgIconManager *manager, const QString &name);
+	static void prefetch(const QString &path, const XdgIconFileKey &file, const XdgIconPixmapKey &key,
+	                     XdgIconPrefetchData *prefetch);
+	static void cancel(XdgIconPrefetchData *prefetch);
+	static void waitFor(const XdgIconPrefetchData *prefetch);
+	static void generateModes(const XdgIconPixmapKey &key, const XdgIconFileKey &file, const QPixmap &pixmap,
+	                          const QList<QIcon::Mode> &modes);
+};
+
+#endif // XDGICONDECODER_P_H
@@ -19,16 +19,24 @@
 #include "xdgiconengine_p.h"
 #include "xdgiconmanager.h"
 #include "xdgicontheme_p.h"
-#include <QPixmapCache>
+#include "xdgiconpixmapcache_p.h"
+#include "xdgicondecoder_p.h"
 #include <QPainter>
-#include <QImageReader>
 #include <QApplication>
 #include <QPalette>
 #include <QStyleOption>
 #include <QStyle>
 
 XdgIconEngine::XdgIconEngine(const QString &id, const QString &theme, const XdgIconManager *manager)
-    : m_id(id), m_theme(theme), m_manager(manager)
+{
+	if (theme.isEmpty()) {
+		m_handle = manager->iconHandle(id);
+	} else if (const XdgIconTheme *th = manager->themeById(theme)) {
+		m_handle = th->iconHandle(id);
+	}
+}
+
+XdgIconEngine::XdgIconEngine(const XdgIconHandle &handle) : m_handle(handle)
 {
 }
 
@@ -43,79 +51,95 @@ void XdgIconEngine::paint(QPainter *painter, const QRect &rect, QIcon::Mode mode
 
 QSize XdgIconEngine::actualSize(const QSize &size, QIcon::Mode, QIcon::State)
 {
-	if (data()) {
+	if (!data().isNull()) {
 		int sizeParams = qMin(size.width(), size.height());
 		return QSize(sizeParams, sizeParams);
 	}
 	return QSize();
 }
 
+/*
+  Stands in for a pixmap being decoded: the icon at another size if that
+  is cached, otherwise nothing. Placeholders are never cached.
+*/
+QPixmap XdgIconEngine::placeholder(const XdgIconPixmapKey &key, int size)
+{
+	QPixmap pixmap;
+	if (XdgIconPixmapCache::instance()->findNearest(key, &pixmap)) {
+		if (pixmap.width() != size || pixmap.height() != size)
+			pixmap = pixmap.scaled(size, size, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+	} else {
+		pixmap = QPixmap(size, size);
+		pixmap.fill(Qt::transparent);
+	}
+	return pixmap;
+}
+
 QPixmap XdgIconEngine::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state)
 {
     Q_UNUSED(state);
 	
-	const XdgIconTheme *th = 0;
-	XdgIconData *d = data(&th);
+	XdgIconData d = data();
     QPixmap pixmap;
-    if (!size.isValid() || !d)
+    if (!size.isValid() || d.isNull())
         return pixmap;
 
     int min = qMin(size.width(), size.height());
-    const XdgIconEntry *entry = d->findEntry(min);
-
-    if (entry) {
-        QString key = QLatin1String("$xdg_icon_");
-        // TODO: Think about how to use QIcon::State,
-		// Qt's default implementation doesn't hold it
-//        key += QString::number(state);
-		key += th->id();
-        key += QLatin1Char('_');
-        key += QString::number(min);
-        key += QString::number(QApplication::palette().cacheKey());
-        key += QLatin1Char('_');
-        key += d->name;
-        key += QString::number(mode);
-
-        if (QPixmapCache::find(key, pixmap))
-            return pixmap;
-
-        bool hasNormalIcon = false;
-
-        if (mode != QIcon::Normal) {
-            key.chop(1);
-            key += QString::number(QIcon::Normal);
-
-            hasNormalIcon = QPixmapCache::find(key, pixmap);
-        }
-
-        if (!hasNormalIcon) {
-            QImage image;
-            QImageReader reader;
-            reader.setFileName(entry->path);
-			QSize minSize(min, min);
-            reader.setScaledSize(minSize);
-            reader.read(&image);
-            pixmap = QPixmap::fromImage(image);
-			if (pixmap.size() != minSize) {
-				pixmap = pixmap.scaled(minSize, Qt::IgnoreAspectRatio,
-				                       Qt::SmoothTransformation);
-			}
-
-            QPixmapCache::insert(key, pixmap);
-        }
-
-        if (mode != QIcon::Normal) {
-            QStyleOption opt(0);
-            opt.palette = QApplication::palette();
-            QPixmap generated = QApplication::style()->generatedIconPixmap(mode, pixmap, &opt);
+    // TODO: Think about how to use QIcon::State,
+	// Qt's default implementation doesn't hold it
+	XdgIconPixmapCache *cache = XdgIconPixmapCache::instance();
+	XdgIconPixmapKey key;
+	key.index = d.index->serial();
+	key.icon = d.icon;
+	key.size = min;
+	key.mode = QIcon::Normal;
+	key.palette = 0;
+	XdgIconPixmapKey modeKey = key;
+	if (mode != QIcon::Normal) {
+		// Only generated pixmaps depend on the palette
+		modeKey.mode = mode;
+		modeKey.palette = QApplication::palette().cacheKey();
+		if (cache->find(modeKey, &pixmap))
+			return pixmap;
+	}
 
-            if (!generated.isNull())
-                pixmap = generated;
+	// Icons reached through other themes or names may share the file
+	XdgIconFileKey file;
+	if (!cache->find(key, &pixmap, &file)) {
+		int entry = d.findEntry(min);
+		if (entry < 0)
+			return pixmap;
+		QString path = d.entryPath(entry);
+		if (!XdgIconPixmapCache::fileKey(path, &file))
+			return pixmap;
+		file.size = min;
+		file.mode = QIcon::Normal;
+		file.palette = 0;
+		if (!cache->find(file, &pixmap)) {
+			const XdgIconManager *manager = m_handle.manager();
+			if (manager && manager->isAsyncDecoding()) {
+				XdgIconDecoder::request(path, file, key, manager, m_handle.name());
+				return placeholder(key, min);
+			}
+			pixmap = QPixmap::fromImage(XdgIconDecoder::decode(path, min));
+		}
+		cache->insert(key, file, pixmap);
+	}
 
-            key.chop(1);
-            key += QString::number(mode);
-            QPixmapCache::insert(key, pixmap);
-        }
+    if (mode != QIcon::Normal) {
+		file.mode = modeKey.mode;
+		file.palette = modeKey.palette;
+		QPixmap generated;
+		if (cache->find(file, &generated)) {
+			pixmap = generated;
+		} else {
+			QStyleOption opt(0);
+			opt.palette = QApplication::palette();
+			generated = QApplication::style()->generatedIconPixmap(mode, pixmap, &opt);
+			if (!generated.isNull())
+				pixmap = generated;
+		}
+		cache->insert(modeKey, file, pixmap);
     }
     return pixmap;
 }
@@ -135,7 +159,7 @@ QString XdgIconEngine::key() const
 
 IconEngineBase *XdgIconEngine::clone() const
 {
-    return new XdgIconEngine(m_id, m_theme, m_manager);
+    return new XdgIconEngine(m_handle);
 }
 
 // TODO: There may be different IconManager's, which we should use?..
@@ -158,22 +182,23 @@ bool XdgIconEngine::write(QDataStream &out) const
 
 void XdgIconEngine::virtual_hook(int id, void *data)
 {
-	XdgIconData *d = XdgIconEngine::data();
-	if (!d)
+	XdgIconData d = XdgIconEngine::data();
+	if (d.isNull())
 		return;
 	switch (id) {
 	case AvailableSizesHook: {
 		AvailableSizesArgument &arg = *reinterpret_cast<AvailableSizesArgument*>(data);
-		for (int i = 0; i < d->entries.size(); i++) {
-			if (d->entries.at(i).dir->type == XdgIconDir::Scalable)
+		for (int i = 0; i < d.entryCount(); i++) {
+			const XdgIconDir *dir = d.entryDir(i);
+			if (!dir || dir->type == XdgIconDir::Scalable)
 				continue;
-			int size = d->entries.at(i).dir->size;
+			int size = dir->size;
 			arg.sizes.append(QSize(size, size));
 		}
 		break;
 	}
 	case IconNameHook:
-		*reinterpret_cast<QString*>(data) = d->name.toString();
+		*reinterpret_cast<QString*>(data) = d.name();
 		break;
 	default:
 		IconEngineBase::virtual_hook(id, data);
@@ -181,10 +206,7 @@ void XdgIconEngine::virtual_hook(int id, void *data)
 	}
 }
 
-XdgIconData *XdgIconEngine::data(const XdgIconTheme **th) const
+XdgIconData XdgIconEngine::data(const XdgIconTheme **th) const
 {
-	const XdgIconTheme *theme = m_theme.isEmpty() ? m_manager->currentTheme() : m_manager->themeById(m_theme);
-	if (th)
-		*th = theme;
-	return theme->data()->findIcon(m_id);
+	return m_handle.data(th);
 }
@@ -31,6 +31,8 @@ typedef QIconEngine IconEngineBase;
 typedef QIconEngineV2 IconEngineBase;
 #endif
 #include "xdgicontheme_p.h"
+#include "xdgiconhandle.h"
+#include "xdgiconpixmapcache_p.h"
 
 class XdgIconManager;
 /**
@@ -40,6 +42,7 @@ class XdgIconEngine : public IconEngineBase
 {
 public:
     XdgIconEngine(const QString &id, const QString &theme, const XdgIconManager *manager);
+    XdgIconEngine(const XdgIconHandle &handle);
     virtual ~XdgIconEngine();
 
     virtual void paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state);
@@ -55,10 +58,9 @@ public:
     virtual bool write(QDataStream &out) const;
     virtual void virtual_hook(int id, void *data);
 protected:
-	XdgIconData *data(const XdgIconTheme **th = 0) const;
-	QString m_id;
-	QString m_theme;
-	const XdgIconManager *m_manager;
+	XdgIconData data(const XdgIconTheme **th = 0) const;
+	static QPixmap placeholder(const XdgIconPixmapKey &key, int size);
+	XdgIconHandle m_handle;
 };
 
 #endif // XDGICONENGINE_P_H
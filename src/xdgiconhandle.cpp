@@ -0,0 +1,137 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "xdgiconhandle.h"
+#include "xdgiconmanager.h"
+#include "xdgiconmanager_p.h"
+#include "xdgicontheme_p.h"
+
+/**
+  Creates a null handle.
+*/
+XdgIconHandle::XdgIconHandle()
+	: m_manager(0), m_fixedTheme(0), m_theme(0), m_icon(-1), m_generation(0), m_resolved(false)
+{
+}
+
+// Out of line, the index snapshot is not known outside of the library
+XdgIconHandle::XdgIconHandle(const XdgIconHandle &other)
+	: m_name(other.m_name), m_manager(other.m_manager), m_fixedTheme(other.m_fixedTheme), m_theme(other.m_theme),
+	  m_index(other.m_index), m_icon(other.m_icon), m_generation(other.m_generation), m_resolved(other.m_resolved)
+{
+}
+
+XdgIconHandle::~XdgIconHandle()
+{
+}
+
+XdgIconHandle &XdgIconHandle::operator=(const XdgIconHandle &other)
+{
+	m_name = other.m_name;
+	m_manager = other.m_manager;
+	m_fixedTheme = other.m_fixedTheme;
+	m_theme = other.m_theme;
+	m_index = other.m_index;
+	m_icon = other.m_icon;
+	m_generation = other.m_generation;
+	m_resolved = other.m_resolved;
+	return *this;
+}
+
+XdgIconHandle::XdgIconHandle(const QString &name, const XdgIconManager *manager, const XdgIconTheme *theme)
+	: m_name(name), m_manager(manager), m_fixedTheme(theme), m_theme(0), m_icon(-1),
+	  m_generation(0), m_resolved(false)
+{
+}
+
+/**
+  Returns true if the handle refers to no theme at all.
+*/
+bool XdgIconHandle::isNull() const
+{
+	return !m_manager && !m_fixedTheme;
+}
+
+/**
+  Returns true if the icon is currently found in the theme or its parents.
+*/
+bool XdgIconHandle::isValid() const
+{
+	return !data().isNull();
+}
+
+/**
+  Returns the icon name the handle was created for.
+*/
+QString XdgIconHandle::name() const
+{
+	return m_name;
+}
+
+/**
+  Returns the theme lookups start from. For handles following the current
+  theme, this is the theme at the time of the call.
+*/
+const XdgIconTheme *XdgIconHandle::theme() const
+{
+	const XdgIconTheme *result = 0;
+	data(&result);
+	return result;
+}
+
+/**
+  Returns the path of the icon file best matching the size, like
+  <code>XdgIconTheme::getIconPath()</code> does.
+*/
+QString XdgIconHandle::iconPath(uint size) const
+{
+	XdgIconData d = data();
+	int entry = d.isNull() ? -1 : d.findEntry(size);
+	return entry < 0 ? QString() : d.entryPath(entry);
+}
+
+/*
+  The lookup is repeated only if the manager generation moved on since the
+  last one; looking the icon up may build indexes, so the generation is
+  read after it.
+*/
+XdgIconData XdgIconHandle::data(const XdgIconTheme **theme) const
+{
+	if (!m_resolved || m_generation != generation()) {
+		m_theme = m_fixedTheme ? m_fixedTheme : (m_manager ? m_manager->currentTheme() : 0);
+		XdgIconData d = m_theme ? m_theme->data()->findIcon(m_name) : XdgIconData();
+		m_index = d.snapshot;
+		m_icon = d.icon;
+		m_generation = generation();
+		m_resolved = true;
+	}
+	if (theme)
+		*theme = m_theme;
+	return m_index ? XdgIconData(m_index, m_icon) : XdgIconData();
+}
+
+const XdgIconManager *XdgIconHandle::manager() const
+{
+	return m_manager ? m_manager : (m_fixedTheme ? m_fixedTheme->manager() : 0);
+}
+
+uint XdgIconHandle::generation() const
+{
+	const XdgIconManager *owner = manager();
+	return owner ? uint(int(owner->d->generation)) : 0;
+}
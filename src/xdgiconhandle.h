@@ -0,0 +1,77 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef XDGICONHANDLE_H
+#define XDGICONHANDLE_H
+
+#include <QtCore/QExplicitlySharedDataPointer>
+#include <QtCore/QString>
+#include "xdgexport.h"
+
+class XdgIconManager;
+class XdgIconTheme;
+class XdgIconIndexSnapshot;
+class XdgIconData;
+
+/**
+  @brief Pre-resolved reference to a themed icon
+
+  A handle remembers where its icon was found. The name is looked up only
+  when the handle is used for the first time, and then again only after
+  the manager's themes or indexes have changed, so using a handle over and
+  over costs no string lookups.
+
+  Handles are obtained from <code>XdgIconManager::iconHandle()</code>, which
+  follows the current theme, or <code>XdgIconTheme::iconHandle()</code>.
+  They are cheap to copy and stay usable as long as the manager exists.
+  Like <code>QString</code>, a handle may be used from any thread, but one
+  handle object must not be used by several threads at once.
+*/
+class XDG_API XdgIconHandle
+{
+public:
+	XdgIconHandle();
+	XdgIconHandle(const XdgIconHandle &other);
+	~XdgIconHandle();
+	XdgIconHandle &operator=(const XdgIconHandle &other);
+
+	bool isNull() const;
+	bool isValid() const;
+	QString name() const;
+	const XdgIconTheme *theme() const;
+	QString iconPath(uint size = 22) const;
+
+private:
+	XdgIconHandle(const QString &name, const XdgIconManager *manager, const XdgIconTheme *theme);
+	XdgIconData data(const XdgIconTheme **theme = 0) const;
+	const XdgIconManager *manager() const;
+	uint generation() const;
+	friend class XdgIconManager;
+	friend class XdgIconTheme;
+	friend class XdgIconEngine;
+	QString m_name;
+	const XdgIconManager *m_manager;
+	const XdgIconTheme *m_fixedTheme;
+	mutable const XdgIconTheme *m_theme;
+	mutable QExplicitlySharedDataPointer<XdgIconIndexSnapshot> m_index;
+	mutable int m_icon;
+	mutable uint m_generation;
+	mutable bool m_resolved;
+};
+
+#endif // XDGICONHANDLE_H
@@ -0,0 +1,1296 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <string.h>
+#include <QtCore/QRunnable>
+#include <QtCore/QSet>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QVarLengthArray>
+#include "xdgiconindex_p.h"
+#include "xdgicontheme_p.h"
+
+namespace
+{
+	// Bump the version on every change of the layout below
+	const char indexMagic[8] = { 'Q', 'X', 'D', 'G', 'I', 'D', 'X', '\0' };
+	const quint32 indexVersion = 7;
+	const quint32 noDir = 0xffffffff;
+	const quint16 noEntry = 0xffff;
+
+	// Sizes above this, and icons with more entries, are not tabulated
+	const quint32 maxTableSize = 0xffff;
+	const int maxTableEntries = 32;
+
+	struct IndexHeader
+	{
+		char magic[8];
+		quint32 version;
+		quint32 size;
+		quint32 checksum;
+		quint32 serial;
+		quint32 dirHash;
+		quint32 basedirCount;
+		quint32 basedirOffset;
+		quint32 dirCount;
+		quint32 dirOffset;
+		quint32 stampCount;
+		quint32 stampOffset;
+		quint32 hashSalt;
+		quint32 seedCount;
+		quint32 seedOffset;
+		quint32 iconCount;
+		quint32 iconOffset;
+		quint32 entryCount;
+		quint32 entryOffset;
+		quint32 rangeCount;
+		quint32 rangeOffset;
+		quint32 suffixCount;
+		quint32 suffixOffset;
+		quint32 poolSize;
+		quint32 poolOffset;
+	};
+
+	// Offset and length of an UTF-8 string in the pool
+	struct IndexString
+	{
+		quint32 offset;
+		quint32 length;
+	};
+
+	// Icons are stored in the order of their perfect hash slots
+	struct IndexIcon
+	{
+		IndexString name;
+		quint32 firstEntry;
+		quint32 entryCount;
+		quint32 firstRange;
+		quint32 rangeCount;
+	};
+
+	/*
+	  The path of an entry is <theme dir>/<dir>/<icon name><suffix>, unless
+	  the suffix is an absolute path itself.
+	*/
+	struct IndexEntry
+	{
+		quint16 basedir;
+		quint16 dir;
+		quint32 suffix;
+	};
+
+	/*
+	  Sizes from this one up to the next range of the icon get this entry
+	  from XdgIconIndex::selectEntry(). The first range of an icon starts
+	  at 0, the last one reaches maxTableSize.
+	*/
+	struct IndexSizeRange
+	{
+		quint16 size;
+		quint16 entry;
+	};
+
+	// Stamp of a theme directory, dir is noDir for the theme root
+	struct IndexStamp
+	{
+		quint32 basedir;
+		quint32 dir;
+		quint32 stamp;
+	};
+
+	const char mergedMagic[8] = { 'Q', 'X', 'D', 'G', 'M', 'R', 'G', '\0' };
+	const quint32 mergedVersion = 3;
+
+	struct MergedHeader
+	{
+		char magic[8];
+		quint32 version;
+		quint32 size;
+		quint32 checksum;
+		quint32 themeCount;
+		quint32 themeOffset;
+		quint32 hashSalt;
+		quint32 seedCount;
+		quint32 seedOffset;
+		quint32 recordCount;
+		quint32 recordOffset;
+	};
+
+	/*
+	  Every name visible from the theme, in perfect hash order. The name
+	  itself is stored by the index it was first found in, theme and icon
+	  are the lookup result after the dash fallbacks have been applied.
+	*/
+	struct MergedRecord
+	{
+		quint32 nameTheme;
+		quint32 nameIcon;
+		quint32 theme;
+		quint32 icon;
+	};
+
+	typedef QVarLengthArray<char, 128> NameBuffer;
+
+	// Same as QString::toUtf8(), but doesn't touch the heap for usual names
+	void encodeName(const QChar *str, int len, NameBuffer &out)
+	{
+		out.resize(0);
+		for (int i = 0; i < len; i++) {
+			uint u = str[i].unicode();
+			if (u < 0x80) {
+				out.append(char(u));
+				continue;
+			}
+			if (u >= 0xd800 && u < 0xdc00 && i + 1 < len) {
+				uint low = str[i + 1].unicode();
+				if (low >= 0xdc00 && low < 0xe000) {
+					u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
+					i++;
+				}
+			}
+			if (u < 0x800) {
+				out.append(char(0xc0 | (u >> 6)));
+			} else {
+				if (u < 0x10000) {
+					out.append(char(0xe0 | (u >> 12)));
+				} else {
+					out.append(char(0xf0 | (u >> 18)));
+					out.append(char(0x80 | ((u >> 12) & 0x3f)));
+				}
+				out.append(char(0x80 | ((u >> 6) & 0x3f)));
+			}
+			out.append(char(0x80 | (u & 0x3f)));
+		}
+	}
+
+	// FNV-1a, it must never change without bumping indexVersion
+	inline quint32 nameHash(const char *str, int len)
+	{
+		quint32 hash = 2166136261u;
+		for (int i = 0; i < len; i++) {
+			hash ^= uchar(str[i]);
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	/*
+	  Checksum of a header, taken with its checksum field zeroed. Whatever
+	  the writer, a header which doesn't match it is never trusted.
+	*/
+	template<typename Header>
+	inline quint32 headerChecksum(Header h)
+	{
+		h.checksum = 0;
+		return nameHash(reinterpret_cast<const char *>(&h), sizeof(h));
+	}
+
+	/*
+	  Minimal perfect hashing, the hash and displace scheme of CHD: names
+	  are split into groups of about keysPerSeed by one half of a 64-bit
+	  hash, and every group, largest first, gets the first seed which moves
+	  all its names to free slots. A lookup is one hash of the name, one
+	  seed read and one slot read, there are no chains to follow.
+	*/
+	const int keysPerSeed = 4;
+	const quint32 maxSeed = 1 << 20;
+
+	inline quint64 nameHash64(const char *str, int len, quint32 salt)
+	{
+		quint64 hash = Q_UINT64_C(14695981039346656037) ^ salt;
+		for (int i = 0; i < len; i++) {
+			hash ^= uchar(str[i]);
+			hash *= Q_UINT64_C(1099511628211);
+		}
+		return hash;
+	}
+
+	inline quint32 perfectSlot(quint64 hash, const quint32 *seeds, quint32 seedCount, quint32 slotCount)
+	{
+		quint64 h = hash ^ (quint64(seeds[quint32(hash >> 32) % seedCount]) * Q_UINT64_C(0x9e3779b97f4a7c15));
+		h ^= h >> 33;
+		h *= Q_UINT64_C(0xff51afd7ed558ccd);
+		h ^= h >> 33;
+		h *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+		h ^= h >> 33;
+		return quint32(h % slotCount);
+	}
+
+	bool placeKeys(const QVector<quint64> &hashes, QVector<quint32> &seeds, QVector<quint32> &places)
+	{
+		quint32 count = hashes.size();
+		quint32 seedCount = seeds.size();
+		QVector<QVector<int> > groups(seedCount);
+		for (quint32 i = 0; i < count; i++)
+			groups[quint32(hashes.at(i) >> 32) % seedCount].append(i);
+		QVector<QPair<int, int> > order(seedCount);
+		for (quint32 g = 0; g < seedCount; g++)
+			order[g] = qMakePair(-groups.at(g).size(), int(g));
+		qSort(order.begin(), order.end());
+
+		QVector<bool> taken(count, false);
+		QVarLengthArray<quint32, 16> groupSlots;
+		for (quint32 i = 0; i < seedCount; i++) {
+			int g = order.at(i).second;
+			const QVector<int> &keys = groups.at(g);
+			if (keys.isEmpty())
+				break;
+			quint32 seed = 0;
+			for (; seed < maxSeed; seed++) {
+				seeds[g] = seed;
+				groupSlots.resize(0);
+				int k = 0;
+				for (; k < keys.size(); k++) {
+					quint32 slot = perfectSlot(hashes.at(keys.at(k)), seeds.constData(), seedCount, count);
+					int j = 0;
+					while (j < k && groupSlots[j] != slot)
+						j++;
+					if (taken.at(slot) || j < k)
+						break;
+					groupSlots.append(slot);
+				}
+				if (k == keys.size())
+					break;
+			}
+			if (seed == maxSeed)
+				return false;
+			for (int k = 0; k < keys.size(); k++) {
+				taken[groupSlots[k]] = true;
+				places[keys.at(k)] = groupSlots[k];
+			}
+		}
+		return true;
+	}
+
+	/*
+	  Fills the seed table for the names and returns the slot of each name.
+	  Names with the same 64-bit hash can't be placed, the salt changes the
+	  hash function for the whole set then. Returns the salt.
+	*/
+	quint32 buildPerfectHash(const QVector<QByteArray> &names, QVector<quint32> &seeds, QVector<quint32> &places)
+	{
+		quint32 seedCount = qMax(1, (names.size() + keysPerSeed - 1) / keysPerSeed);
+		QVector<quint64> hashes(names.size());
+		for (quint32 salt = 0; ; salt++) {
+			for (int i = 0; i < names.size(); i++)
+				hashes[i] = nameHash64(names.at(i).constData(), names.at(i).size(), salt);
+			seeds.fill(0, seedCount);
+			places.fill(0, names.size());
+			if (placeKeys(hashes, seeds, places))
+				return salt;
+		}
+	}
+
+	inline bool checkTable(quint32 offset, quint32 count, quint32 recordSize, qint64 size)
+	{
+		return !(offset & 3) && quint64(offset) + quint64(count) * recordSize <= quint64(size);
+	}
+
+	inline const IndexHeader *header(const uchar *base)
+	{
+		return reinterpret_cast<const IndexHeader *>(base);
+	}
+
+	template <typename T>
+	inline const T *table(const uchar *base, quint32 offset)
+	{
+		return reinterpret_cast<const T *>(base + offset);
+	}
+
+	inline const char *poolData(const uchar *base, const IndexString &str)
+	{
+		const IndexHeader *h = header(base);
+		if (quint64(str.offset) + str.length > h->poolSize)
+			return 0;
+		return reinterpret_cast<const char *>(base + h->poolOffset + str.offset);
+	}
+
+	// Icon names are cut at the last dash for fallbacks, but never to nothing
+	inline int fallbackLength(const char *name, int length)
+	{
+		while (--length > 0) {
+			if (name[length] == '-')
+				return length;
+		}
+		return 0;
+	}
+
+	// Directory parameters the size tables were computed with
+	quint32 dirHash(const XdgIconDir *dirs, int count)
+	{
+		QVector<quint32> values;
+		values.reserve(count * 5);
+		for (const XdgIconDir *dir = dirs; dir < dirs + count; ++dir)
+			values << dir->size << quint32(dir->type) << dir->maxsize << dir->minsize << dir->threshold;
+		return nameHash(reinterpret_cast<const char *>(values.constData()), values.size() * sizeof(quint32));
+	}
+
+	inline void addPoint(QVarLengthArray<quint32, 128> &points, quint64 point)
+	{
+		if (point <= maxTableSize)
+			points.append(quint32(point));
+	}
+
+	/*
+	  Tabulates selectEntry() over all sizes. The distance of a dir is 0 on
+	  an interval and grows by 1 per pixel on both sides of it, so the choice
+	  can only change at interval bounds and halfway between the upper bound
+	  of one dir and the lower bound of another; it is evaluated right at
+	  those points only.
+	*/
+	void appendSizeRanges(const XdgIconDir *const *dirs, int count, QVector<IndexSizeRange> &ranges)
+	{
+		QVarLengthArray<quint64, maxTableEntries> lows(count), highs(count);
+		for (int i = 0; i < count; i++) {
+			const XdgIconDir &dir = *dirs[i];
+			switch (dir.type) {
+			case XdgIconDir::Fixed:
+				lows[i] = highs[i] = dir.size;
+				break;
+			case XdgIconDir::Scalable:
+				lows[i] = dir.minsize;
+				highs[i] = dir.maxsize;
+				break;
+			case XdgIconDir::Threshold:
+				// Wraps around exactly like the unsigned checks do
+				lows[i] = quint32(dir.size - dir.threshold);
+				highs[i] = quint32(dir.size + dir.threshold);
+				break;
+			}
+		}
+		QVarLengthArray<quint32, 128> points;
+		points.append(0);
+		for (int i = 0; i < count; i++) {
+			addPoint(points, lows[i]);
+			addPoint(points, highs[i] + 1);
+			for (int j = 0; j < count; j++) {
+				if (highs[j] < lows[i]) {
+					quint64 middle = (lows[i] + highs[j]) / 2;
+					addPoint(points, middle);
+					addPoint(points, middle + 1);
+				}
+			}
+		}
+		qSort(points.begin(), points.end());
+		int last = -2;
+		for (int i = 0; i < points.size(); i++) {
+			int entry = XdgIconIndex::selectEntry(dirs, count, points[i]);
+			if (entry == last)
+				continue;
+			IndexSizeRange range;
+			range.size = quint16(points[i]);
+			range.entry = entry < 0 ? noEntry : quint16(entry);
+			ranges.append(range);
+			last = entry;
+		}
+	}
+
+	inline IndexString appendString(QByteArray &pool, const QByteArray &str)
+	{
+		IndexString result;
+		result.offset = pool.size();
+		result.length = str.size();
+		pool.append(str);
+		return result;
+	}
+}
+
+/**
+  Returns the directory with the path, or 0.
+*/
+const XdgIconDir *xdgFindIconDir(const XdgIconDirList &dirs, const QString &path)
+{
+	int low = 0;
+	int high = dirs.size();
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (dirs.at(middle).path < path)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low < dirs.size() && dirs.at(low).path == path ? &dirs.at(low) : 0;
+}
+
+XdgIconIndex::XdgIconIndex() : m_base(0), m_size(0), m_map(0), m_valid(false), m_dirs(0)
+{
+}
+
+XdgIconIndex::~XdgIconIndex()
+{
+	clear();
+}
+
+/**
+  Maps the cache file into memory. The file stays mapped until
+  <code>clear()</code> is called, so it must never be truncated in place.
+*/
+bool XdgIconIndex::load(const QString &fileName)
+{
+	clear();
+	m_file.setFileName(fileName);
+	if (!m_file.open(QIODevice::ReadOnly))
+		return false;
+	qint64 size = m_file.size();
+	if (size >= qint64(sizeof(IndexHeader)))
+		m_map = m_file.map(0, size);
+	if (!m_map || !setImage(m_map, size)) {
+		clear();
+		return false;
+	}
+	return true;
+}
+
+/**
+  Uses an image produced by <code>XdgIconIndexBuilder::build()</code>.
+*/
+bool XdgIconIndex::load(const QByteArray &data)
+{
+	clear();
+	m_data = data;
+	if (!setImage(reinterpret_cast<const uchar *>(m_data.constData()), m_data.size())) {
+		clear();
+		return false;
+	}
+	return true;
+}
+
+/**
+  Resolves the dir table of the image against the theme's directories. The
+  index becomes valid only if it was built for the same theme directories
+  and every directory it refers to is still known.
+*/
+bool XdgIconIndex::attach(const XdgIconDirList &subdirs, const QStringList &themeDirs)
+{
+	m_valid = false;
+	if (!m_base)
+		return false;
+	const IndexHeader *h = header(m_base);
+	if (h->basedirCount != quint32(themeDirs.size()))
+		return false;
+	const IndexString *basedirPaths = table<IndexString>(m_base, h->basedirOffset);
+	for (quint32 i = 0; i < h->basedirCount; i++) {
+		const char *path = poolData(m_base, basedirPaths[i]);
+		QByteArray expected = themeDirs.at(i).toUtf8();
+		if (!path || basedirPaths[i].length != quint32(expected.size())
+		        || memcmp(path, expected.constData(), expected.size()) != 0)
+			return false;
+	}
+	// Records refer to dirs by their position in the list
+	if (h->dirCount != quint32(subdirs.size()))
+		return false;
+	const IndexString *dirs = table<IndexString>(m_base, h->dirOffset);
+	for (quint32 i = 0; i < h->dirCount; i++) {
+		const char *path = poolData(m_base, dirs[i]);
+		if (!path || QString::fromUtf8(path, dirs[i].length) != subdirs.at(i).path)
+			return false;
+	}
+	// Sizes of the dirs changed, the size tables are out of date
+	if (h->dirHash != dirHash(subdirs.constData(), subdirs.size()))
+		return false;
+	m_dirs = subdirs.constData();
+	m_valid = true;
+	return true;
+}
+
+/**
+  Returns the directory stamps recorded when the index was built.
+*/
+QHash<XdgIconSource, quint32> XdgIconIndex::stamps() const
+{
+	QHash<XdgIconSource, quint32> result;
+	if (!m_valid)
+		return result;
+	const IndexHeader *h = header(m_base);
+	const IndexStamp *stamps = table<IndexStamp>(m_base, h->stampOffset);
+	result.reserve(h->stampCount);
+	for (quint32 i = 0; i < h->stampCount; i++) {
+		const IndexStamp &rec = stamps[i];
+		if (rec.basedir >= h->basedirCount || (rec.dir != noDir && rec.dir >= h->dirCount))
+			continue;
+		const XdgIconDir *dir = rec.dir == noDir ? 0 : m_dirs + rec.dir;
+		result.insert(XdgIconSource(rec.basedir, dir), rec.stamp);
+	}
+	return result;
+}
+
+/**
+  Copies entries and stamps to the builder, except for the ones which come
+  from the listed sources. This is how an index is patched after only some
+  of its directories have changed.
+
+  An index of a single base directory can be copied into a builder for
+  more of them, <code>basedir</code> is then the position of that
+  directory in the builder.
+*/
+void XdgIconIndex::copyTo(XdgIconIndexBuilder &builder, const QList<XdgIconSource> &skip, int basedir) const
+{
+	if (!m_valid)
+		return;
+	QSet<XdgIconSource> skipDirs;
+	QSet<int> skipBasedirs;
+	foreach (const XdgIconSource &source, skip) {
+		if (source.dir)
+			skipDirs.insert(source);
+		else
+			skipBasedirs.insert(source.basedir);
+	}
+	const IndexHeader *h = header(m_base);
+	QHash<XdgIconSource, quint32> stampHash = stamps();
+	QHash<XdgIconSource, quint32>::const_iterator it = stampHash.constBegin();
+	for (; it != stampHash.constEnd(); ++it) {
+		if (!skipBasedirs.contains(it.key().basedir) && !skipDirs.contains(it.key()))
+			builder.addStamp(basedir < 0 ? it.key() : XdgIconSource(basedir, it.key().dir), it.value());
+	}
+	const IndexIcon *icons = table<IndexIcon>(m_base, h->iconOffset);
+	const IndexEntry *entries = table<IndexEntry>(m_base, h->entryOffset);
+	for (quint32 i = 0; i < h->iconCount; i++) {
+		const char *name = poolData(m_base, icons[i].name);
+		int count = entryCount(i);
+		if (!name)
+			continue;
+		for (int j = 0; j < count; j++) {
+			const IndexEntry &entry = entries[icons[i].firstEntry + j];
+			if (entry.suffix >= h->suffixCount || entry.dir >= h->dirCount || entry.basedir >= h->basedirCount)
+				continue;
+			const IndexString &suffix = table<IndexString>(m_base, h->suffixOffset)[entry.suffix];
+			const char *suffixData = poolData(m_base, suffix);
+			if (!suffixData)
+				continue;
+			XdgIconSource source(entry.basedir, m_dirs + entry.dir);
+			if (skipBasedirs.contains(source.basedir) || skipDirs.contains(source))
+				continue;
+			builder.addEntry(QByteArray::fromRawData(name, icons[i].name.length), basedir < 0 ? source.basedir : basedir, source.dir,
+			                 QByteArray::fromRawData(suffixData, suffix.length));
+		}
+	}
+}
+
+void XdgIconIndex::clear()
+{
+	if (m_map) {
+		m_file.unmap(m_map);
+		m_map = 0;
+	}
+	if (m_file.isOpen())
+		m_file.close();
+	m_data.clear();
+	m_dirs = 0;
+	m_base = 0;
+	m_size = 0;
+	m_valid = false;
+}
+
+bool XdgIconIndex::setImage(const uchar *base, qint64 size)
+{
+	if (size < qint64(sizeof(IndexHeader)) || (quintptr(base) & 3))
+		return false;
+	const IndexHeader *h = header(base);
+	if (memcmp(h->magic, indexMagic, sizeof(indexMagic)) != 0
+	        || h->version != indexVersion || h->size != size
+	        || h->checksum != headerChecksum(*h))
+		return false;
+	if (!checkTable(h->basedirOffset, h->basedirCount, sizeof(IndexString), size)
+	        || !checkTable(h->dirOffset, h->dirCount, sizeof(IndexString), size)
+	        || !checkTable(h->stampOffset, h->stampCount, sizeof(IndexStamp), size)
+	        || !checkTable(h->seedOffset, h->seedCount, sizeof(quint32), size)
+	        || (h->iconCount && !h->seedCount)
+	        || !checkTable(h->iconOffset, h->iconCount, sizeof(IndexIcon), size)
+	        || !checkTable(h->entryOffset, h->entryCount, sizeof(IndexEntry), size)
+	        || !checkTable(h->rangeOffset, h->rangeCount, sizeof(IndexSizeRange), size)
+	        || !checkTable(h->suffixOffset, h->suffixCount, sizeof(IndexString), size)
+	        || quint64(h->poolOffset) + h->poolSize > quint64(size))
+		return false;
+	m_base = base;
+	m_size = size;
+	return true;
+}
+
+/**
+  Returns a checksum of the image, which identifies its contents.
+*/
+quint32 XdgIconIndex::serial() const
+{
+	return m_valid ? header(m_base)->serial : 0;
+}
+
+int XdgIconIndex::iconCount() const
+{
+	return m_valid ? int(header(m_base)->iconCount) : 0;
+}
+
+int XdgIconIndex::findIcon(const QStringRef &name) const
+{
+	if (!m_valid)
+		return -1;
+	const IndexHeader *h = header(m_base);
+	if (!h->iconCount)
+		return -1;
+	NameBuffer key;
+	encodeName(name.unicode(), name.size(), key);
+	quint64 hash = nameHash64(key.constData(), key.size(), h->hashSalt);
+	quint32 i = perfectSlot(hash, table<quint32>(m_base, h->seedOffset), h->seedCount, h->iconCount);
+	// Every name maps to some slot, so the name has to be compared
+	const IndexIcon &icon = table<IndexIcon>(m_base, h->iconOffset)[i];
+	const char *str = poolData(m_base, icon.name);
+	if (str && icon.name.length == quint32(key.size()) && memcmp(str, key.constData(), key.size()) == 0)
+		return int(i);
+	return -1;
+}
+
+const char *XdgIconIndex::iconNameData(int icon, int *length) const
+{
+	if (!m_valid || quint32(icon) >= header(m_base)->iconCount)
+		return 0;
+	const IndexIcon &rec = table<IndexIcon>(m_base, header(m_base)->iconOffset)[icon];
+	*length = int(rec.name.length);
+	return poolData(m_base, rec.name);
+}
+
+QString XdgIconIndex::iconName(int icon) const
+{
+	if (!m_valid || quint32(icon) >= header(m_base)->iconCount)
+		return QString();
+	const IndexIcon &rec = table<IndexIcon>(m_base, header(m_base)->iconOffset)[icon];
+	const char *str = poolData(m_base, rec.name);
+	return str ? QString::fromUtf8(str, rec.name.length) : QString();
+}
+
+int XdgIconIndex::entryCount(int icon) const
+{
+	if (!m_valid)
+		return 0;
+	const IndexHeader *h = header(m_base);
+	if (quint32(icon) >= h->iconCount)
+		return 0;
+	const IndexIcon &rec = table<IndexIcon>(m_base, h->iconOffset)[icon];
+	if (quint64(rec.firstEntry) + rec.entryCount > h->entryCount)
+		return 0;
+	return int(rec.entryCount);
+}
+
+const XdgIconDir *XdgIconIndex::entryDir(int icon, int entry) const
+{
+	if (entry < 0 || entry >= entryCount(icon))
+		return 0;
+	const IndexHeader *h = header(m_base);
+	quint32 first = table<IndexIcon>(m_base, h->iconOffset)[icon].firstEntry;
+	quint32 dir = table<IndexEntry>(m_base, h->entryOffset)[first + entry].dir;
+	return dir < h->dirCount ? m_dirs + dir : 0;
+}
+
+/**
+  Returns the entry of the icon which suits the size best. The choice is
+  read from the size table of the icon, which the builder computed with
+  <code>selectEntry()</code>.
+*/
+int XdgIconIndex::findEntry(int icon, uint size) const
+{
+	int count = entryCount(icon);
+	if (!count)
+		return -1;
+	const IndexHeader *h = header(m_base);
+	const IndexIcon &rec = table<IndexIcon>(m_base, h->iconOffset)[icon];
+	if (size <= maxTableSize && rec.rangeCount && quint64(rec.firstRange) + rec.rangeCount <= h->rangeCount) {
+		const IndexSizeRange *ranges = table<IndexSizeRange>(m_base, h->rangeOffset) + rec.firstRange;
+		int low = 0;
+		int high = int(rec.rangeCount);
+		while (high - low > 1) {
+			int middle = (low + high) / 2;
+			if (ranges[middle].size <= size)
+				low = middle;
+			else
+				high = middle;
+		}
+		int entry = ranges[low].entry;
+		return entry < count ? entry : -1;
+	}
+	QVarLengthArray<const XdgIconDir *, maxTableEntries> dirs(count);
+	for (int i = 0; i < count; i++)
+		dirs[i] = entryDir(icon, i);
+	return selectEntry(dirs.constData(), count, size);
+}
+
+/**
+  Chooses among the dirs of an icon's entries as the specification says:
+  the first dir matching the size exactly, otherwise the closest one. Null
+  dirs are skipped.
+*/
+int XdgIconIndex::selectEntry(const XdgIconDir *const *dirs, int count, uint size)
+{
+	for (int i = 0; i < count; i++) {
+		if (dirs[i] && XdgIconThemePrivate::dirMatchesSize(*dirs[i], size))
+			return i;
+	}
+	uint minDistance = 0;
+	int entry = -1;
+	for (int i = 0; i < count; i++) {
+		if (!dirs[i])
+			continue;
+		uint distance = XdgIconThemePrivate::dirSizeDistance(*dirs[i], size);
+		if (entry < 0 || distance < minDistance) {
+			minDistance = distance;
+			entry = i;
+		}
+	}
+	return entry;
+}
+
+QString XdgIconIndex::entryPath(int icon, int entry) const
+{
+	if (entry < 0 || entry >= entryCount(icon))
+		return QString();
+	const IndexHeader *h = header(m_base);
+	const IndexIcon &icn = table<IndexIcon>(m_base, h->iconOffset)[icon];
+	const IndexEntry &rec = table<IndexEntry>(m_base, h->entryOffset)[icn.firstEntry + entry];
+	if (rec.suffix >= h->suffixCount || rec.dir >= h->dirCount || rec.basedir >= h->basedirCount)
+		return QString();
+	const IndexString &suffix = table<IndexString>(m_base, h->suffixOffset)[rec.suffix];
+	const char *suffixData = poolData(m_base, suffix);
+	if (suffixData && suffix.length && *suffixData == '/')
+		return QString::fromUtf8(suffixData, suffix.length);
+	const IndexString parts[] = {
+		table<IndexString>(m_base, h->basedirOffset)[rec.basedir],
+		table<IndexString>(m_base, h->dirOffset)[rec.dir],
+		icn.name,
+		suffix
+	};
+	QVarLengthArray<char, 256> path;
+	for (int i = 0; i < 4; i++) {
+		const char *str = poolData(m_base, parts[i]);
+		if (!str)
+			return QString();
+		path.append(str, parts[i].length);
+		if (i < 2)
+			path.append('/');
+	}
+	return QString::fromUtf8(path.constData(), path.size());
+}
+
+XdgIconIndexBuilder::XdgIconIndexBuilder(const XdgIconDirList &subdirs, const QStringList &themeDirs)
+    : m_dirs(subdirs.constData())
+{
+	foreach (const QString &themeDir, themeDirs)
+		m_basedirPaths << themeDir.toUtf8();
+	foreach (const XdgIconDir &dir, subdirs)
+		m_dirPaths << dir.path.toUtf8();
+}
+
+void XdgIconIndexBuilder::addEntry(const QString &name, int basedir, const XdgIconDir *dir, const QString &path)
+{
+	int dirPos = dirIndex(dir);
+	if (dirPos < 0)
+		return;
+	NameBuffer buffer;
+	encodeName(name.constData(), name.size(), buffer);
+	Entry entry;
+	entry.basedir = basedir;
+	entry.dir = dirPos;
+	// Only the part of the file name after the icon name is kept
+	QByteArray utf8Path = path.toUtf8();
+	QByteArray prefix = m_basedirPaths.at(basedir);
+	prefix.append('/').append(m_dirPaths.at(entry.dir)).append('/').append(buffer.constData(), buffer.size());
+	if (utf8Path.startsWith(prefix) && utf8Path.indexOf('/', prefix.size()) < 0)
+		entry.suffix = utf8Path.mid(prefix.size());
+	else
+		entry.suffix = utf8Path;
+	int icon = iconIndex(QByteArray::fromRawData(buffer.constData(), buffer.size()));
+	m_icons[icon].entries.append(entry);
+}
+
+/**
+  Same as above for an already UTF-8 encoded name and the suffix of its
+  file, as stored in an index. Both are copied, so they may point into a
+  mapped index.
+*/
+void XdgIconIndexBuilder::addEntry(const QByteArray &name, int basedir, const XdgIconDir *dir, const QByteArray &suffix)
+{
+	int dirPos = dirIndex(dir);
+	if (dirPos < 0)
+		return;
+	Entry entry;
+	entry.basedir = basedir;
+	entry.dir = dirPos;
+	entry.suffix = QByteArray(suffix.constData(), suffix.size());
+	m_icons[iconIndex(name)].entries.append(entry);
+}
+
+/**
+  Records the stamp a directory had right before it was scanned.
+*/
+void XdgIconIndexBuilder::addStamp(const XdgIconSource &source, quint32 stamp)
+{
+	int dir = source.dir ? dirIndex(source.dir) : -1;
+	if (!source.dir || dir >= 0)
+		m_stamps.insert(qMakePair(source.basedir, dir), stamp);
+}
+
+/**
+  Adds all entries and stamps of the other builder. Both builders must have
+  been created for the same directories.
+*/
+void XdgIconIndexBuilder::merge(const XdgIconIndexBuilder &other)
+{
+	Q_ASSERT(m_dirPaths == other.m_dirPaths);
+	for (int i = 0; i < other.m_icons.size(); i++) {
+		const Icon &icon = other.m_icons.at(i);
+		int index = iconIndex(icon.name);
+		m_icons[index].entries += icon.entries;
+	}
+	QMap<QPair<int, int>, quint32>::const_iterator it = other.m_stamps.constBegin();
+	for (; it != other.m_stamps.constEnd(); ++it)
+		m_stamps.insert(it.key(), it.value());
+}
+
+int XdgIconIndexBuilder::dirIndex(const XdgIconDir *dir) const
+{
+	return dir >= m_dirs && dir < m_dirs + m_dirPaths.size() ? int(dir - m_dirs) : -1;
+}
+
+int XdgIconIndexBuilder::iconIndex(const QByteArray &name)
+{
+	QHash<QByteArray, int>::const_iterator it = m_iconIndex.constFind(name);
+	if (it != m_iconIndex.constEnd())
+		return it.value();
+	Icon icon;
+	// The name may be a raw data wrapper around a stack buffer
+	icon.name = QByteArray(name.constData(), name.size());
+	m_iconIndex.insert(icon.name, m_icons.size());
+	m_icons.append(icon);
+	return m_icons.size() - 1;
+}
+
+QByteArray XdgIconIndexBuilder::build() const
+{
+	QVector<QByteArray> names(m_icons.size());
+	for (int i = 0; i < m_icons.size(); i++)
+		names[i] = m_icons.at(i).name;
+	QVector<quint32> seeds, places;
+	quint32 salt = buildPerfectHash(names, seeds, places);
+	QVector<int> iconAt(m_icons.size());
+	for (int i = 0; i < m_icons.size(); i++)
+		iconAt[places.at(i)] = i;
+	quint32 entryCount = 0;
+	for (int i = 0; i < m_icons.size(); i++)
+		entryCount += m_icons.at(i).entries.size();
+
+	QByteArray pool;
+	QVector<IndexString> basedirs(m_basedirPaths.size());
+	for (int i = 0; i < m_basedirPaths.size(); i++)
+		basedirs[i] = appendString(pool, m_basedirPaths.at(i));
+	QVector<IndexString> dirs(m_dirPaths.size());
+	for (int i = 0; i < m_dirPaths.size(); i++)
+		dirs[i] = appendString(pool, m_dirPaths.at(i));
+
+	QVector<IndexStamp> stamps;
+	stamps.reserve(m_stamps.size());
+	QMap<QPair<int, int>, quint32>::const_iterator it = m_stamps.constBegin();
+	for (; it != m_stamps.constEnd(); ++it) {
+		IndexStamp stamp;
+		stamp.basedir = it.key().first;
+		stamp.dir = it.key().second < 0 ? noDir : quint32(it.key().second);
+		stamp.stamp = it.value();
+		stamps.append(stamp);
+	}
+
+	QVector<IndexIcon> icons(m_icons.size());
+	QVector<IndexEntry> entries;
+	entries.reserve(entryCount);
+	QVector<IndexSizeRange> ranges;
+	QVarLengthArray<const XdgIconDir *, maxTableEntries> entryDirs;
+	// Themes use a handful of extensions, every one is stored once
+	QHash<QByteArray, int> suffixIndex;
+	QVector<IndexString> suffixes;
+	for (int i = 0; i < m_icons.size(); i++) {
+		const Icon &icon = m_icons.at(iconAt.at(i));
+		IndexIcon &rec = icons[i];
+		rec.name = appendString(pool, icon.name);
+		rec.firstEntry = entries.size();
+		rec.entryCount = icon.entries.size();
+		QVector<Entry> sorted = icon.entries;
+		qStableSort(sorted.begin(), sorted.end());
+		for (int j = 0; j < sorted.size(); j++) {
+			const QByteArray &suffix = sorted.at(j).suffix;
+			QHash<QByteArray, int>::const_iterator suffixIt = suffixIndex.constFind(suffix);
+			if (suffixIt == suffixIndex.constEnd()) {
+				suffixIt = suffixIndex.insert(suffix, suffixes.size());
+				suffixes.append(appendString(pool, suffix));
+			}
+			IndexEntry entry;
+			entry.basedir = sorted.at(j).basedir;
+			entry.dir = sorted.at(j).dir;
+			entry.suffix = suffixIt.value();
+			entries.append(entry);
+		}
+		rec.firstRange = ranges.size();
+		if (sorted.size() <= maxTableEntries) {
+			entryDirs.resize(sorted.size());
+			for (int j = 0; j < sorted.size(); j++)
+				entryDirs[j] = m_dirs + sorted.at(j).dir;
+			appendSizeRanges(entryDirs.constData(), entryDirs.size(), ranges);
+		}
+		rec.rangeCount = ranges.size() - rec.firstRange;
+	}
+
+	IndexHeader h;
+	memcpy(h.magic, indexMagic, sizeof(indexMagic));
+	h.version = indexVersion;
+	h.basedirCount = basedirs.size();
+	h.basedirOffset = sizeof(IndexHeader);
+	h.dirCount = dirs.size();
+	h.dirOffset = h.basedirOffset + h.basedirCount * sizeof(IndexString);
+	h.stampCount = stamps.size();
+	h.stampOffset = h.dirOffset + h.dirCount * sizeof(IndexString);
+	h.hashSalt = salt;
+	h.seedCount = seeds.size();
+	h.seedOffset = h.stampOffset + h.stampCount * sizeof(IndexStamp);
+	h.iconCount = icons.size();
+	h.iconOffset = h.seedOffset + h.seedCount * sizeof(quint32);
+	h.entryCount = entries.size();
+	h.entryOffset = h.iconOffset + h.iconCount * sizeof(IndexIcon);
+	h.rangeCount = ranges.size();
+	h.rangeOffset = h.entryOffset + h.entryCount * sizeof(IndexEntry);
+	h.suffixCount = suffixes.size();
+	h.suffixOffset = h.rangeOffset + h.rangeCount * sizeof(IndexSizeRange);
+	h.poolSize = pool.size();
+	h.poolOffset = h.suffixOffset + h.suffixCount * sizeof(IndexString);
+	h.size = h.poolOffset + h.poolSize;
+	h.checksum = 0;
+	h.serial = 0;
+	h.dirHash = dirHash(m_dirs, m_dirPaths.size());
+
+	QByteArray image(h.size, '\0');
+	char *data = image.data();
+	memcpy(data, &h, sizeof(h));
+	memcpy(data + h.basedirOffset, basedirs.constData(), h.basedirCount * sizeof(IndexString));
+	memcpy(data + h.dirOffset, dirs.constData(), h.dirCount * sizeof(IndexString));
+	memcpy(data + h.stampOffset, stamps.constData(), h.stampCount * sizeof(IndexStamp));
+	memcpy(data + h.seedOffset, seeds.constData(), h.seedCount * sizeof(quint32));
+	memcpy(data + h.iconOffset, icons.constData(), h.iconCount * sizeof(IndexIcon));
+	memcpy(data + h.entryOffset, entries.constData(), h.entryCount * sizeof(IndexEntry));
+	memcpy(data + h.rangeOffset, ranges.constData(), h.rangeCount * sizeof(IndexSizeRange));
+	memcpy(data + h.suffixOffset, suffixes.constData(), h.suffixCount * sizeof(IndexString));
+	memcpy(data + h.poolOffset, pool.constData(), h.poolSize);
+	h.serial = nameHash(data, h.size);
+	h.checksum = headerChecksum(h);
+	memcpy(data, &h, sizeof(h));
+	return image;
+}
+
+XdgIconMergedIndex::XdgIconMergedIndex() : m_base(0), m_size(0), m_map(0), m_valid(false)
+{
+}
+
+XdgIconMergedIndex::~XdgIconMergedIndex()
+{
+	clear();
+}
+
+bool XdgIconMergedIndex::load(const QString &fileName)
+{
+	clear();
+	m_file.setFileName(fileName);
+	if (!m_file.open(QIODevice::ReadOnly))
+		return false;
+	qint64 size = m_file.size();
+	if (size >= qint64(sizeof(MergedHeader)))
+		m_map = m_file.map(0, size);
+	if (!m_map || !setImage(m_map, size)) {
+		clear();
+		return false;
+	}
+	return true;
+}
+
+bool XdgIconMergedIndex::load(const QByteArray &data)
+{
+	clear();
+	m_data = data;
+	if (!setImage(reinterpret_cast<const uchar *>(m_data.constData()), m_data.size())) {
+		clear();
+		return false;
+	}
+	return true;
+}
+
+/**
+  Binds the image to the indexes of the inheritance chain. This fails if the
+  image was built for other indexes, or other versions of them.
+*/
+bool XdgIconMergedIndex::attach(const QVector<const XdgIconIndex *> &chain)
+{
+	m_valid = false;
+	m_chain.clear();
+	if (!m_base)
+		return false;
+	const MergedHeader *h = reinterpret_cast<const MergedHeader *>(m_base);
+	if (h->themeCount != quint32(chain.size()))
+		return false;
+	const quint32 *serials = table<quint32>(m_base, h->themeOffset);
+	for (int i = 0; i < chain.size(); i++) {
+		if (!chain.at(i)->isValid() || serials[i] != chain.at(i)->serial())
+			return false;
+	}
+	m_chain = chain;
+	m_valid = true;
+	return true;
+}
+
+void XdgIconMergedIndex::clear()
+{
+	if (m_map) {
+		m_file.unmap(m_map);
+		m_map = 0;
+	}
+	if (m_file.isOpen())
+		m_file.close();
+	m_data.clear();
+	m_chain.clear();
+	m_base = 0;
+	m_size = 0;
+	m_valid = false;
+}
+
+/**
+  Looks up a name the way the specification says, trying the names with
+  the last dash-separated part removed in the theme before going on to its
+  parents. The longest known prefix of the name already holds the answer,
+  so an existing name takes a single probe.
+*/
+bool XdgIconMergedIndex::find(const QStringRef &name, int *theme, int *icon) const
+{
+	if (!m_valid)
+		return false;
+	const MergedHeader *h = reinterpret_cast<const MergedHeader *>(m_base);
+	if (!h->recordCount)
+		return false;
+	NameBuffer key;
+	encodeName(name.unicode(), name.size(), key);
+	const quint32 *seeds = table<quint32>(m_base, h->seedOffset);
+	const MergedRecord *records = table<MergedRecord>(m_base, h->recordOffset);
+	for (int length = key.size(); length > 0; length = fallbackLength(key.constData(), length)) {
+		quint64 hash = nameHash64(key.constData(), length, h->hashSalt);
+		const MergedRecord &rec = records[perfectSlot(hash, seeds, h->seedCount, h->recordCount)];
+		if (rec.nameTheme >= h->themeCount || rec.theme >= h->themeCount)
+			return false;
+		int nameLength = 0;
+		const char *str = m_chain.at(rec.nameTheme)->iconNameData(rec.nameIcon, &nameLength);
+		if (!str || nameLength != length || memcmp(str, key.constData(), length) != 0)
+			continue;
+		if (int(rec.icon) >= m_chain.at(rec.theme)->iconCount())
+			return false;
+		*theme = int(rec.theme);
+		*icon = int(rec.icon);
+		return true;
+	}
+	return false;
+}
+
+namespace
+{
+	// Batches smaller than this are not worth starting threads for
+	const int minParallelNames = 4096;
+
+	class NameLess
+	{
+	public:
+		NameLess(const QStringList &names) : m_names(names) {}
+		bool operator()(int a, int b) const { return m_names.at(a) < m_names.at(b); }
+	private:
+		const QStringList &m_names;
+	};
+
+	// Resolves a slice of the distinct names of findPaths()
+	class PathJob : public QRunnable
+	{
+	public:
+		PathJob(const XdgIconMergedIndex &merged, const QStringList &names, const int *unique,
+		        QString *paths, int count, uint size)
+			: m_merged(merged), m_names(names), m_unique(unique), m_paths(paths), m_count(count), m_size(size) {}
+
+		void run()
+		{
+			for (int i = 0; i < m_count; i++)
+				m_paths[i] = m_merged.findPath(QStringRef(&m_names.at(m_unique[i])), m_size);
+		}
+
+	private:
+		const XdgIconMergedIndex &m_merged;
+		const QStringList &m_names;
+		const int *m_unique;
+		QString *m_paths;
+		int m_count;
+		uint m_size;
+	};
+}
+
+/**
+  Same as <code>find()</code> followed by the entry of the icon which suits
+  the size best. Returns an empty string if there is no such icon.
+*/
+QString XdgIconMergedIndex::findPath(const QStringRef &name, uint size) const
+{
+	int theme, icon;
+	if (!find(name, &theme, &icon))
+		return QString();
+	const XdgIconIndex *index = m_chain.at(theme);
+	int entry = index->findEntry(icon, size);
+	return entry < 0 ? QString() : index->entryPath(icon, entry);
+}
+
+/**
+  Resolves many names at once, and returns their paths in the order of the
+  names, with empty strings for missing icons. The names are sorted, so
+  each distinct one is looked up once and the equal ones share the path.
+  Big batches are split between threads.
+*/
+QStringList XdgIconMergedIndex::findPaths(const QStringList &names, uint size) const
+{
+	int count = names.size();
+	QVector<int> order(count);
+	for (int i = 0; i < count; i++)
+		order[i] = i;
+	qSort(order.begin(), order.end(), NameLess(names));
+	// Position of the name of each input among the distinct names
+	QVector<int> unique;
+	QVector<int> owner(count);
+	for (int k = 0; k < count; k++) {
+		int i = order.at(k);
+		if (k == 0 || names.at(i) != names.at(order.at(k - 1)))
+			unique << i;
+		owner[i] = unique.size() - 1;
+	}
+
+	QVector<QString> paths(unique.size());
+	int threads = qMin(QThread::idealThreadCount(), unique.size() / (minParallelNames / 2));
+	if (unique.size() >= minParallelNames && threads > 1) {
+		QThreadPool pool;
+		pool.setMaxThreadCount(threads);
+		int chunk = (unique.size() + threads - 1) / threads;
+		for (int first = 0; first < unique.size(); first += chunk) {
+			int length = qMin(chunk, unique.size() - first);
+			pool.start(new PathJob(*this, names, unique.constData() + first, paths.data() + first, length, size));
+		}
+		pool.waitForDone();
+	} else {
+		PathJob(*this, names, unique.constData(), paths.data(), unique.size(), size).run();
+	}
+
+	QStringList result;
+	result.reserve(count);
+	for (int i = 0; i < count; i++)
+		result << paths.at(owner.at(i));
+	return result;
+}
+
+/**
+  Builds the merged image for the indexes of an inheritance chain, given in
+  lookup order.
+*/
+QByteArray XdgIconMergedIndex::build(const QVector<const XdgIconIndex *> &chain)
+{
+	// The first index a name shows up in wins
+	QHash<QByteArray, int> names;
+	QVector<QByteArray> keys;
+	QVector<MergedRecord> records;
+	for (int t = 0; t < chain.size(); t++) {
+		int count = chain.at(t)->iconCount();
+		for (int i = 0; i < count; i++) {
+			MergedRecord rec;
+			int length = 0;
+			const char *str = chain.at(t)->iconNameData(i, &length);
+			if (!str)
+				continue;
+			QByteArray name = QByteArray::fromRawData(str, length);
+			if (names.contains(name))
+				continue;
+			rec.nameTheme = rec.theme = t;
+			rec.nameIcon = rec.icon = i;
+			names.insert(name, records.size());
+			keys.append(name);
+			records.append(rec);
+		}
+	}
+
+	// A shorter name found in an earlier theme beats the exact one
+	for (int r = 0; r < records.size(); r++) {
+		MergedRecord &rec = records[r];
+		int length = 0;
+		const char *str = chain.at(rec.nameTheme)->iconNameData(rec.nameIcon, &length);
+		while ((length = fallbackLength(str, length)) > 0) {
+			QHash<QByteArray, int>::const_iterator it = names.constFind(QByteArray::fromRawData(str, length));
+			if (it == names.constEnd())
+				continue;
+			const MergedRecord &prefix = records.at(it.value());
+			if (prefix.nameTheme < rec.theme) {
+				rec.theme = prefix.nameTheme;
+				rec.icon = prefix.nameIcon;
+			}
+		}
+	}
+
+	QVector<quint32> seeds, places;
+	quint32 salt = buildPerfectHash(keys, seeds, places);
+	QVector<MergedRecord> placed(records.size());
+	for (int r = 0; r < records.size(); r++)
+		placed[places.at(r)] = records.at(r);
+	QVector<quint32> serials(chain.size());
+	for (int t = 0; t < chain.size(); t++)
+		serials[t] = chain.at(t)->serial();
+
+	MergedHeader h;
+	memcpy(h.magic, mergedMagic, sizeof(mergedMagic));
+	h.version = mergedVersion;
+	h.themeCount = serials.size();
+	h.themeOffset = sizeof(MergedHeader);
+	h.hashSalt = salt;
+	h.seedCount = seeds.size();
+	h.seedOffset = h.themeOffset + h.themeCount * sizeof(quint32);
+	h.recordCount = placed.size();
+	h.recordOffset = h.seedOffset + h.seedCount * sizeof(quint32);
+	h.size = h.recordOffset + h.recordCount * sizeof(MergedRecord);
+	h.checksum = headerChecksum(h);
+
+	QByteArray image(h.size, '\0');
+	char *data = image.data();
+	memcpy(data, &h, sizeof(h));
+	memcpy(data + h.themeOffset, serials.constData(), h.themeCount * sizeof(quint32));
+	memcpy(data + h.seedOffset, seeds.constData(), h.seedCount * sizeof(quint32));
+	memcpy(data + h.recordOffset, placed.constData(), h.recordCount * sizeof(MergedRecord));
+	return image;
+}
+
+bool XdgIconMergedIndex::setImage(const uchar *base, qint64 size)
+{
+	if (size < qint64(sizeof(MergedHeader)) || (quintptr(base) & 3))
+		return false;
+	const MergedHeader *h = reinterpret_cast<const MergedHeader *>(base);
+	if (memcmp(h->magic, mergedMagic, sizeof(mergedMagic)) != 0
+	        || h->version != mergedVersion || h->size != size
+	        || h->checksum != headerChecksum(*h))
+		return false;
+	if (!checkTable(h->themeOffset, h->themeCount, sizeof(quint32), size)
+	        || !checkTable(h->seedOffset, h->seedCount, sizeof(quint32), size)
+	        || (h->recordCount && !h->seedCount)
+	        || !checkTable(h->recordOffset, h->recordCount, sizeof(MergedRecord), size))
+		return false;
+	m_base = base;
+	m_size = size;
+	return true;
+}
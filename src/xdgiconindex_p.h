@@ -0,0 +1,204 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef XDGICONINDEX_P_H
+#define XDGICONINDEX_P_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QPair>
+#include <QtCore/QStringList>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+struct XdgIconDir;
+class XdgIconIndexBuilder;
+
+/**
+  @private
+
+  Directories of a theme in a single array, sorted by path. The list is
+  not modified once the theme is set up, indexes use positions in it and
+  lookups hold pointers into it.
+*/
+typedef QVector<XdgIconDir> XdgIconDirList;
+
+const XdgIconDir *xdgFindIconDir(const XdgIconDirList &dirs, const QString &path);
+
+/**
+  @private
+
+  Directory of a theme in one of its base directories. A null dir stands
+  for the whole theme directory of the base directory.
+*/
+struct XdgIconSource
+{
+	inline XdgIconSource(int b = -1, const XdgIconDir *d = 0) : basedir(b), dir(d) {}
+	inline bool operator==(const XdgIconSource &o) const { return basedir == o.basedir && dir == o.dir; }
+	int basedir;
+	const XdgIconDir *dir;
+};
+
+inline uint qHash(const XdgIconSource &source)
+{ return qHash(source.dir) ^ uint(source.basedir); }
+
+/**
+  @private
+
+  Read-only icon index of a single theme. The index is a flat binary image
+  (header, basedir and dir tables, directory stamps, perfect hash seeds,
+  icon and entry records, size tables, string pool) which is either
+  memory-mapped from a cache file or kept in memory right after a
+  directory scan. Lookups work on the image in place, so loading a cache
+  costs the same regardless of the theme size.
+*/
+class XdgIconIndex
+{
+	Q_DISABLE_COPY(XdgIconIndex)
+public:
+	XdgIconIndex();
+	~XdgIconIndex();
+
+	bool load(const QString &fileName);
+	bool load(const QByteArray &data);
+	bool attach(const XdgIconDirList &subdirs, const QStringList &themeDirs);
+	void clear();
+	inline bool isValid() const { return m_valid; }
+
+	QHash<XdgIconSource, quint32> stamps() const;
+	void copyTo(XdgIconIndexBuilder &builder, const QList<XdgIconSource> &skip, int basedir = -1) const;
+
+	quint32 serial() const;
+	int iconCount() const;
+	int findIcon(const QStringRef &name) const;
+	const char *iconNameData(int icon, int *length) const;
+	QString iconName(int icon) const;
+	int entryCount(int icon) const;
+	const XdgIconDir *entryDir(int icon, int entry) const;
+	QString entryPath(int icon, int entry) const;
+	int findEntry(int icon, uint size) const;
+
+	static int selectEntry(const XdgIconDir *const *dirs, int count, uint size);
+
+	// Stamp values with a special meaning, see XdgIconScanner::dirStamp()
+	enum { UnknownStamp = 0, MissingStamp = 0xffffffff };
+
+private:
+	bool setImage(const uchar *base, qint64 size);
+	const uchar *m_base;
+	quint32 m_size;
+	uchar *m_map;
+	bool m_valid;
+	QFile m_file;
+	QByteArray m_data;
+	const XdgIconDir *m_dirs;
+};
+
+/**
+  @private
+
+  Collects scanned icon files and directory stamps and serializes them into
+  the binary image understood by <code>XdgIconIndex</code>. Entries of an
+  icon are ordered by base directory and then by directory, which is the
+  order <code>XdgIconData::findEntry()</code> honors; this keeps the result
+  independent of the order directories were scanned or patched in. Builders
+  created for the same theme can be merged, which is how partial results of
+  parallel scans are combined.
+
+  Paths are not stored: an entry keeps the indexes of its base and theme
+  directories and the rest of the file name after the icon name, which
+  themes share between thousands of files (".png", ".svg").
+*/
+class XdgIconIndexBuilder
+{
+public:
+	XdgIconIndexBuilder(const XdgIconDirList &subdirs, const QStringList &themeDirs);
+
+	void addEntry(const QString &name, int basedir, const XdgIconDir *dir, const QString &path);
+	void addEntry(const QByteArray &name, int basedir, const XdgIconDir *dir, const QByteArray &suffix);
+	void addStamp(const XdgIconSource &source, quint32 stamp);
+	void merge(const XdgIconIndexBuilder &other);
+	QByteArray build() const;
+
+private:
+	struct Entry
+	{
+		inline bool operator<(const Entry &o) const
+		{ return basedir < o.basedir || (basedir == o.basedir && dir < o.dir); }
+		int basedir;
+		int dir;
+		QByteArray suffix;
+	};
+	struct Icon
+	{
+		QByteArray name;
+		QVector<Entry> entries;
+	};
+	int iconIndex(const QByteArray &name);
+	QList<QByteArray> m_basedirPaths;
+	QList<QByteArray> m_dirPaths;
+	int dirIndex(const XdgIconDir *dir) const;
+	const XdgIconDir *m_dirs;
+	QMap<QPair<int, int>, quint32> m_stamps;
+	QHash<QByteArray, int> m_iconIndex;
+	QVector<Icon> m_icons;
+};
+
+/**
+  @private
+
+  Lookup table over all the indexes of a theme's inheritance chain. It maps
+  every name visible from the theme to the index and icon a lookup would
+  end up with, dash fallbacks included, so the chain doesn't have to be
+  walked. Names are not copied, records point to the icons of the chain.
+  The image can be memory-mapped from a cache file just like an index; it
+  records the serials of the indexes it was built from.
+*/
+class XdgIconMergedIndex
+{
+	Q_DISABLE_COPY(XdgIconMergedIndex)
+public:
+	XdgIconMergedIndex();
+	~XdgIconMergedIndex();
+
+	bool load(const QString &fileName);
+	bool load(const QByteArray &data);
+	bool attach(const QVector<const XdgIconIndex *> &chain);
+	void clear();
+	inline bool isValid() const { return m_valid; }
+
+	bool find(const QStringRef &name, int *theme, int *icon) const;
+	QString findPath(const QStringRef &name, uint size) const;
+	QStringList findPaths(const QStringList &names, uint size) const;
+
+	static QByteArray build(const QVector<const XdgIconIndex *> &chain);
+
+private:
+	bool setImage(const uchar *base, qint64 size);
+	const uchar *m_base;
+	quint32 m_size;
+	uchar *m_map;
+	bool m_valid;
+	QFile m_file;
+	QByteArray m_data;
+	QVector<const XdgIconIndex *> m_chain;
+};
+
+#endif // XDGICONINDEX_P_H
@@ -16,12 +16,50 @@
     Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include <QtCore/QDataStream>
 #include <QtCore/QDir>
 #include <QtCore/QDirIterator>
-#include <QtCore/QSettings>
+#include <QtCore/QFile>
+#include <QtCore/QMetaObject>
+#include <QtCore/QThread>
 #include <QtCore/QVector>
 #include "xdgenvironment.h"
 #include "xdgiconmanager_p.h"
+#include "xdgiconscanner_p.h"
+#include "xdgthemechooser_p.h"
+#ifdef QT_GUI_LIB
+#include "xdgicondecoder_p.h"
+#include "xdgiconpixmapcache_p.h"
+#endif
+
+namespace
+{
+    const quint32 manifestMagic = 0x51584d46; // "QXMF"
+    const quint32 manifestVersion = 3;
+
+    /*
+      Cache directories are created once, lookups only build paths in them.
+      The runtime dir is only used if it is a per-user one, other users
+      could plant caches in a shared temporary directory.
+    */
+    struct CacheDirs
+    {
+        CacheDirs()
+        {
+            home = XdgEnvironment::cacheHome().absoluteFilePath(QLatin1String("qxdg"));
+            QDir().mkpath(home);
+            QDir runtimeDir = XdgEnvironment::runtimeDir();
+            if (runtimeDir != QDir::temp()) {
+                runtime = runtimeDir.absoluteFilePath(QLatin1String("qxdg"));
+                QDir().mkpath(runtime);
+            }
+        }
+        QString home;
+        QString runtime;
+    };
+}
+
+Q_GLOBAL_STATIC(CacheDirs, cacheDirs)
 
 /**
   Creates a new icon manager that searches icons in base directories returned
@@ -30,7 +68,8 @@
   @arg appDirs: Optional. Specifies custom directories to search for icons
     and icon themes in, in addition to system default directories.
 */
-XdgIconManager::XdgIconManager(const QList<QDir> &appDirs) : d(new XdgIconManagerPrivate(this))
+XdgIconManager::XdgIconManager(const QList<QDir> &appDirs, QObject *parent)
+    : QObject(parent), d(new XdgIconManagerPrivate(this))
 {
     d->rules.insert(QRegExp(QLatin1String("gnome"), Qt::CaseInsensitive), &xdgGetGnomeTheme);
     d->rules.insert(QRegExp(QLatin1String("kde"), Qt::CaseInsensitive), &xdgGetKdeTheme);
@@ -46,11 +85,15 @@ XdgIconManager::~XdgIconManager()
 	delete d;
 }
 
+XdgIconManagerPrivate::~XdgIconManagerPrivate()
+{
+    // Every theme has its own ID, themes only holds a subset of them
+    qDeleteAll(themeIdMap);
+}
+
 void XdgIconManagerPrivate::init(const QList<QDir> &appDirs)
 {
     // Identify base directories
-    QLatin1String hicolorString("hicolor");
-    QVector<QDir> basedirs;
     QDir basedir(QDir::home());
 
     if(basedir.cd(QLatin1String(".icons")) && !basedirs.contains(basedir))
@@ -72,65 +115,245 @@ void XdgIconManagerPrivate::init(const QList<QDir> &appDirs)
     if (basedir.exists() && !basedirs.contains(basedir))
         basedirs.append(basedir);
 
-    // Build theme list
-    foreach (QDir dir, basedirs) {
-        QDirIterator subdirs(dir);
+    if (!loadManifest()) {
+        loadThemes();
+        saveManifest();
+    }
+}
+
+/**
+  Builds the list of theme IDs and their index files. Only the base
+  directories are listed here, themes are parsed by <code>loadTheme()</code>
+  once they are asked for. Themes which are already known are kept, so this
+  can be called again to pick up newly installed themes. Returns true if new
+  themes were found.
+*/
+bool XdgIconManagerPrivate::loadThemes()
+{
+    QLatin1String hicolorString("hicolor");
+    bool found = false;
+
+    basedirStamps.clear();
+    foreach (const QDir &dir, basedirs)
+        basedirStamps << XdgIconScanner::dirStamp(dir.absolutePath());
+    manifestDirty = true;
+
+    foreach (const QDir &dir, basedirs) {
+        QDirIterator subdirs(dir.absolutePath(), QDir::Dirs | QDir::NoDotAndDotDot);
 
         while (subdirs.hasNext()) {
-            QFileInfo subdir(subdirs.next());
+            subdirs.next();
+            QString id = subdirs.fileName();
 
-            if (!subdir.isDir())
+            if (!themeFiles.value(id).isEmpty())
                 continue;
 
-            QString index = QDir(subdir.canonicalFilePath()).absoluteFilePath(QLatin1String("index.theme"));
+            QString index = subdirs.filePath() + QLatin1String("/index.theme");
+
+            if (QFile::exists(index)) {
+                themeFiles.insert(id, index);
+                found = true;
+            }
+        }
+    }
 
-            if (QFileInfo(index).exists()) {
-                QSettings settings(index, QSettings::IniFormat);
-                QString name = settings.value(QLatin1String("Icon Theme/Name")).toString();
+    // An empty path stands for an empty theme - hicolor will be guaranteed to always exist
+    if (!themeFiles.contains(hicolorString)) {
+        themeFiles.insert(hicolorString, QString());
+        found = true;
+    }
 
-                if (!name.isEmpty()) {
-                    QMap<QString, XdgIconTheme *>::const_iterator it = themes.constFind(name);
-                    XdgIconTheme *theme;
-                    if (it == themes.constEnd()) {
-                        theme = new XdgIconTheme(basedirs, subdir.fileName(), q, index);
-                        themes.insert(name, theme);
-                    } else
-                        theme = it.value();
+    if (!found)
+        return false;
+
+    allThemesLoaded = false;
+    // Parents may have been installed after the theme
+    foreach (XdgIconTheme *theme, themeIdMap)
+        resolveParents(theme);
+    // Cached lookup results may depend on the old parents. Themes loaded
+    // later can't be in any snapshot yet, so they don't need this
+    if (!themeIdMap.isEmpty())
+        generation.ref();
+    return true;
+}
 
-                    themeIdMap.insert(subdir.fileName(), theme);
-                }
-            }
+/**
+  Returns the theme with the given ID, creating it on first use. Its parents
+  are created as well.
+*/
+XdgIconTheme *XdgIconManagerPrivate::loadTheme(const QString &id) const
+{
+    QMutexLocker locker(&lock);
+    QMap<QString, XdgIconTheme *>::const_iterator it = themeIdMap.constFind(id);
+    if (it != themeIdMap.constEnd())
+        return it.value();
+
+    QMap<QString, QString>::iterator fileIt = themeFiles.find(id);
+    if (fileIt == themeFiles.end())
+        return 0;
+
+    XdgIconTheme *theme = 0;
+    QMap<QString, QByteArray>::const_iterator recordIt = records.constFind(id);
+    if (recordIt != records.constEnd()) {
+        theme = new XdgIconTheme(basedirs, id, q);
+        if (!theme->p->restoreRecord(recordIt.value(), fileIt.value())) {
+            delete theme;
+            theme = 0;
         }
     }
+    if (!theme) {
+        theme = new XdgIconTheme(basedirs, id, q, fileIt.value());
+        if (theme->name().isEmpty()) {
+            // Not a valid theme
+            themeFiles.erase(fileIt);
+            records.remove(id);
+            delete theme;
+            return 0;
+        }
+        if (!fileIt.value().isEmpty()) {
+            records.insert(id, theme->p->saveRecord(fileIt.value()));
+            manifestDirty = true;
+        }
+    }
+
+    // Insert it before resolving parents to cope with inheritance loops
+    themeIdMap.insert(id, theme);
+    loadDepth++;
+    resolveParents(theme);
+    loadDepth--;
+    // Parents are in the manifest as well, write it once for all of them
+    if (loadDepth == 0 && manifestDirty)
+        saveManifest();
+    return theme;
+}
+
+void XdgIconManagerPrivate::resolveParents(XdgIconTheme *theme) const
+{
+    QLatin1String hicolorString("hicolor");
+
+    if (theme->id() == hicolorString)
+        return;
+
+    // Not addParent(), which would wait for merged indexes being built
+    // without the manager lock. A theme being loaded has none yet, and
+    // loadThemes() moves the generation on for the others
+    QVector<const XdgIconTheme *> &parents = theme->p->parents;
+    parents.clear();
 
-    const XdgIconTheme *hicolor = themeIdMap.value(hicolorString);
+    if (theme->parentIds().isEmpty()) {
+        if (const XdgIconTheme *hicolor = loadTheme(hicolorString))
+            parents.append(hicolor);
+        return;
+    }
 
-    if (!hicolor) {
-        // create empty theme - hicolor will be guaranteed to always exist
-        XdgIconTheme *newTheme = new XdgIconTheme(basedirs, hicolorString, q);
-        themes.insert(hicolorString, newTheme);
-        themeIdMap.insert(hicolorString, newTheme);
-        hicolor = newTheme;
+    foreach (const QString &parent, theme->parentIds()) {
+        const XdgIconTheme *parentTheme = loadTheme(parent);
+        if (parentTheme && !parents.contains(parentTheme))
+            parents.append(parentTheme);
     }
+}
 
-    // Resolve dependencies
-    for(QMap<QString, XdgIconTheme*>::iterator it = themes.begin(); it != themes.end(); ++it) {
-        XdgIconTheme &theme = *it.value();
+/*
+  Caches live in the XDG cache home, they can be rebuilt at any time.
+*/
+QString XdgIconManagerPrivate::cacheDir()
+{
+    return cacheDirs()->home;
+}
 
-        if (theme.id() == hicolorString)
-            continue;
+/*
+  Returns the dir for hot copies of the theme caches, or an empty string
+  if they are not kept.
+*/
+QString XdgIconManagerPrivate::runtimeCacheDir() const
+{
+    return runtimeCache != 0 ? cacheDirs()->runtime : QString();
+}
 
-        if (theme.parentIds().isEmpty()) {
-            theme.addParent(hicolor);
-            continue;
-        }
+QString XdgIconManagerPrivate::manifestPath()
+{
+    return cacheDir() + QLatin1String("/themes.manifest");
+}
 
-        foreach (QString parent, theme.parentIds()) {
-            const XdgIconTheme *parentTheme = themeIdMap.value(parent);
-            if(parentTheme)
-                theme.addParent(parentTheme);
-        }
+/**
+  Restores the theme list from the manifest. Returns false if there is no
+  manifest or the base directories changed since it was written; the theme
+  records are kept in that case, each of them is validated on its own.
+*/
+bool XdgIconManagerPrivate::loadManifest()
+{
+    QFile file(manifestPath());
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_2);
+    quint32 magic = 0, version = 0;
+    in >> magic >> version;
+    if (magic != manifestMagic || version != manifestVersion)
+        return false;
+
+    QStringList paths;
+    QList<quint32> stamps;
+    QMap<QString, QString> files;
+    QMap<QString, QByteArray> themeRecords;
+    in >> paths >> stamps >> files >> themeRecords;
+    if (in.status() != QDataStream::Ok || paths.size() != basedirs.size() || stamps.size() != basedirs.size())
+        return false;
+    for (int i = 0; i < basedirs.size(); i++) {
+        if (paths.at(i) != basedirs.at(i).absolutePath())
+            return false;
+    }
+    records = themeRecords;
+
+    for (int i = 0; i < basedirs.size(); i++) {
+        quint32 stamp = stamps.at(i);
+        if (stamp == XdgIconIndex::UnknownStamp || stamp != XdgIconScanner::dirStamp(paths.at(i)))
+            return false;
     }
+    basedirStamps = stamps;
+    themeFiles = files;
+    manifestDirty = false;
+    return true;
+}
+
+void XdgIconManagerPrivate::saveManifest() const
+{
+    QStringList paths;
+    foreach (const QDir &dir, basedirs)
+        paths << dir.absolutePath();
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_2);
+    out << manifestMagic << manifestVersion;
+    out << paths << basedirStamps << themeFiles << records;
+    if (out.status() == QDataStream::Ok)
+        XdgIconThemePrivate::writeCache(manifestPath(), data);
+    manifestDirty = false;
+}
+
+/**
+  Creates all themes, which is needed to look them up by name.
+*/
+void XdgIconManagerPrivate::loadAllThemes() const
+{
+    QMutexLocker locker(&lock);
+    if (allThemesLoaded)
+        return;
+
+    loadDepth++;
+    foreach (const QString &id, themeFiles.keys())
+        loadTheme(id);
+    loadDepth--;
+    if (manifestDirty)
+        saveManifest();
+
+    themes.clear();
+    foreach (XdgIconTheme *theme, themeIdMap) {
+        if (!themes.contains(theme->name()))
+            themes.insert(theme->name(), theme);
+    }
+    allThemesLoaded = true;
 }
 
 /**
@@ -139,7 +362,9 @@ void XdgIconManagerPrivate::init(const QList<QDir> &appDirs)
 */
 void XdgIconManager::clearRules()
 {
+    QMutexLocker locker(&d->lock);
     d->rules.clear();
+    d->defaultThemeId.clear();
 }
 
 /**
@@ -149,7 +374,9 @@ void XdgIconManager::clearRules()
 */
 void XdgIconManager::installRule(const QRegExp &regexp, XdgThemeChooser chooser)
 {
+    QMutexLocker locker(&d->lock);
     d->rules.insert(regexp, chooser);
+    d->defaultThemeId.clear();
 }
 
 /**
@@ -164,9 +391,21 @@ void XdgIconManager::installRule(const QRegExp &regexp, XdgThemeChooser chooser)
     checked to be present.
   @arg If nothing else works, the fallback "hicolor" theme is returned.
 
+  The result is remembered. In watching mode it is determined again once
+  the desktop settings change.
+
   This function is guaranteed to always return a non-null theme object.
 */
 const XdgIconTheme *XdgIconManager::defaultTheme() const
+{
+    QMutexLocker locker(&d->lock);
+    if (d->defaultThemeId.isNull())
+        d->defaultThemeId = d->detectTheme();
+    const XdgIconTheme *theme = themeById(d->defaultThemeId);
+    return theme ? theme : themeById(QLatin1String("hicolor"));
+}
+
+QString XdgIconManagerPrivate::detectTheme() const
 {
     XdgThemeChooser chooser = 0;
     QByteArray env = qgetenv("DESKTOP_SESSION");
@@ -174,14 +413,13 @@ const XdgIconTheme *XdgIconManager::defaultTheme() const
 
     QHash<QRegExp, XdgThemeChooser>::const_iterator it;
 
-    for (it = d->rules.begin(); it != d->rules.end(); ++it) {
+    for (it = rules.begin(); it != rules.end(); ++it) {
         // FIXME: Is it really needed to use regular expressions here?
         if(it.key().indexIn(session) != -1) {
             chooser = it.value();
             break;
         }
     }
-	qDebug("!!!!!!! '%s' '%p' '%s'", env.constData(), chooser, qPrintable(chooser ? (*chooser)() : QString()));
 
     if(!chooser) {
         if (qgetenv("KDE_FULL_SESSION") == "true")
@@ -190,27 +428,111 @@ const XdgIconTheme *XdgIconManager::defaultTheme() const
             chooser = &xdgGetGnomeTheme;
     }
 
-    return themeById(chooser ? (*chooser)() : QLatin1String("hicolor"));
+    QString id = chooser ? (*chooser)() : QString();
+    return id.isEmpty() ? QLatin1String("hicolor") : id;
 }
 
 void XdgIconManager::setCurrentTheme(const QString &id)
 {
+	QMutexLocker locker(&d->lock);
 	d->currentTheme = themeById(id);
+	d->customTheme = true;
+	// Handles following the current theme have to look up again
+	d->generation.ref();
 }
 
+/**
+  Returns the theme set with <code>setCurrentTheme()</code>, or the default
+  theme. Like lookups, this may be called from any thread.
+*/
 const XdgIconTheme *XdgIconManager::currentTheme() const
 {
+	if (const XdgIconTheme *theme = d->currentTheme)
+		return theme;
+	QMutexLocker locker(&d->lock);
 	if (!d->currentTheme)
 		d->currentTheme = defaultTheme();
 	return d->currentTheme;
 }
 
+/**
+  Returns a handle for the icon in the current theme. The handle follows
+  changes of the current theme.
+*/
+XdgIconHandle XdgIconManager::iconHandle(const QString &iconName) const
+{
+	return XdgIconHandle(iconName, this, 0);
+}
+
+#ifdef QT_GUI_LIB
+/**
+  Starts decoding the icons in the current theme at the sizes, for each of
+  the modes, so that they are cached before they are painted for the first
+  time. Names are looked up at once; files are decoded once, however many
+  names and themes lead to them, in parallel by a few worker threads.
+  Pixmaps which are cached already are not decoded again.
+
+  Must be called from the GUI thread. The pixmaps are cached while the
+  event loop runs, or when <code>XdgIconPrefetch::waitForFinished()</code>
+  is called.
+*/
+XdgIconPrefetch XdgIconManager::prefetch(const QStringList &iconNames, const QList<uint> &sizes,
+                                         const QList<QIcon::Mode> &modes) const
+{
+	XdgIconPrefetch result;
+	result.d->modes = modes;
+	const XdgIconTheme *theme = currentTheme();
+	if (!theme)
+		return result;
+	XdgIconPixmapCache *cache = XdgIconPixmapCache::instance();
+	QStringList names = iconNames;
+	names.sort();
+	for (int i = 0; i < names.size(); i++) {
+		if (i > 0 && names.at(i) == names.at(i - 1))
+			continue;
+		XdgIconData data = theme->data()->findIcon(names.at(i));
+		if (data.isNull())
+			continue;
+		foreach (uint size, sizes) {
+			XdgIconPixmapKey key;
+			key.index = data.index->serial();
+			key.icon = data.icon;
+			key.size = size;
+			key.mode = QIcon::Normal;
+			key.palette = 0;
+			QPixmap pixmap;
+			XdgIconFileKey file;
+			if (!cache->find(key, &pixmap, &file)) {
+				int entry = data.findEntry(size);
+				if (entry < 0)
+					continue;
+				QString path = data.entryPath(entry);
+				if (!XdgIconPixmapCache::fileKey(path, &file))
+					continue;
+				file.size = size;
+				file.mode = QIcon::Normal;
+				file.palette = 0;
+				if (!cache->find(file, &pixmap)) {
+					XdgIconDecoder::prefetch(path, file, key, result.d.data());
+					continue;
+				}
+				cache->insert(key, file, pixmap);
+			}
+			XdgIconDecoder::generateModes(key, file, pixmap, modes);
+		}
+	}
+	return result;
+}
+#endif
+
 /**
   Returns a theme by its human-readable name (like "GNOME Noble"), or 0 if no
   theme with this name was found.
 */
 const XdgIconTheme *XdgIconManager::themeByName(const QString &themeName) const
 {
+    QMutexLocker locker(&d->lock);
+    d->loadAllThemes();
     return d->themes.value(themeName, 0);
 }
 
@@ -221,7 +543,7 @@ const XdgIconTheme *XdgIconManager::themeByName(const QString &themeName) const
 */
 const XdgIconTheme *XdgIconManager::themeById(const QString &themeName) const
 {
-    return d->themeIdMap.value(themeName, 0);
+    return d->loadTheme(themeName);
 }
 
 /**
@@ -231,6 +553,9 @@ const XdgIconTheme *XdgIconManager::themeById(const QString &themeName) const
 */
 QStringList XdgIconManager::themeNames(bool showHidden) const
 {
+    QMutexLocker locker(&d->lock);
+    d->loadAllThemes();
+
     if (showHidden) {
         return QStringList(d->themes.keys());
     }
@@ -255,9 +580,12 @@ QStringList XdgIconManager::themeNames(bool showHidden) const
 */
 QStringList XdgIconManager::themeIds(bool showHidden) const
 {
+    QMutexLocker locker(&d->lock);
+    // Only themes which load are listed, invalid index files are dropped
+    d->loadAllThemes();
     if (showHidden)
         return QStringList(d->themeIdMap.keys());
-	
+
     QStringList out;
 	QMapIterator<QString, XdgIconTheme *> it(d->themeIdMap);
 	while (it.hasNext()) {
@@ -267,3 +595,230 @@ QStringList XdgIconManager::themeIds(bool showHidden) const
 	}
     return out;
 }
+
+/**
+  Enables or disables watching mode. While watching, the manager tracks
+  its base directories, the directories of the themes which are in use and
+  the configuration files the default theme is read from. Changes are
+  collected for a short while, then the affected theme indexes are updated
+  incrementally and <code>changed()</code> is emitted.
+
+  Watching is off by default.
+*/
+void XdgIconManager::setWatching(bool watch)
+{
+	if (watch == isWatching())
+		return;
+	if (!watch) {
+		delete d->watcher;
+		delete d->updateTimer;
+		d->watcher = 0;
+		d->updateTimer = 0;
+		d->changedPaths.clear();
+		return;
+	}
+	d->watcher = new QFileSystemWatcher(this);
+	connect(d->watcher, SIGNAL(directoryChanged(QString)), this, SLOT(_q_pathChanged(QString)));
+	connect(d->watcher, SIGNAL(fileChanged(QString)), this, SLOT(_q_pathChanged(QString)));
+	// Package managers touch lots of dirs at once, handle them in one go
+	d->updateTimer = new QTimer(this);
+	d->updateTimer->setSingleShot(true);
+	d->updateTimer->setInterval(500);
+	connect(d->updateTimer, SIGNAL(timeout()), this, SLOT(_q_update()));
+
+	QStringList paths = XdgIconManagerPrivate::configFiles();
+	foreach (const QDir &dir, d->basedirs)
+		paths << dir.absolutePath();
+	d->watchPaths(paths);
+	QMutexLocker locker(&d->lock);
+	foreach (XdgIconTheme *theme, d->themeIdMap) {
+		if (theme->data()->index.load())
+			d->watchPaths(theme->data()->watchPaths());
+	}
+}
+
+/**
+  Returns whether the manager is in watching mode.
+*/
+bool XdgIconManager::isWatching() const
+{
+	return d->watcher != 0;
+}
+
+/**
+  Enables or disables keeping copies of the theme caches in the runtime
+  directory (<code>XdgEnvironment::runtimeDir()</code>), which is usually
+  a memory file system. The copies are read in place of the ones in the
+  cache home, which may be on a network file system. Caches are written
+  to both places.
+
+  Nothing is kept if there is no per-user runtime directory. Only caches
+  loaded after the call are affected. Off by default.
+*/
+void XdgIconManager::setRuntimeCacheEnabled(bool enable)
+{
+	d->runtimeCache = enable ? 1 : 0;
+}
+
+/**
+  Builds the cache of a theme ahead of time, so the first lookup does not
+  have to scan it.
+
+  @arg UserCache: Brings the caches of the current user up to date, for
+    the theme and its parents.
+  @arg SystemCache: Scans each base directory holding the theme and writes
+    a cache next to it, which the library takes in place of a scan for all
+    users, as long as the theme does not change. This needs write access
+    to the base directories and is meant for packagers, see the
+    <code>qxdg-update-cache</code> tool.
+
+  Returns false if the theme does not exist or nothing could be written.
+*/
+bool XdgIconManager::updateCache(const QString &themeId, CacheLocation location)
+{
+	const XdgIconTheme *theme = themeById(themeId);
+	if (!theme)
+		return false;
+	if (location == SystemCache)
+		return theme->data()->saveSystemCaches();
+	if (!theme->data()->updateIndex())
+		theme->data()->ensureDirectoryMaps();
+	theme->data()->ensureMergedIndex();
+	return true;
+}
+
+/**
+  Returns whether copies of the caches are kept in the runtime directory.
+*/
+bool XdgIconManager::isRuntimeCacheEnabled() const
+{
+	return !d->runtimeCacheDir().isEmpty();
+}
+
+/**
+  Enables or disables asynchronous decoding, which is off by default.
+  Pixmaps which are not cached yet are then decoded by worker threads;
+  meanwhile icons are painted from a cached pixmap of another size, or
+  left transparent, and <code>iconDecoded()</code> tells when they can be
+  painted properly. Only affects icons of this manager's themes.
+*/
+void XdgIconManager::setAsyncDecoding(bool enable)
+{
+	d->asyncDecoding = enable;
+}
+
+/**
+  Returns whether icon pixmaps are decoded asynchronously.
+*/
+bool XdgIconManager::isAsyncDecoding() const
+{
+	return d->asyncDecoding;
+}
+
+/*
+  Themes are watched only once their index has been loaded, a theme which
+  is not in use will be revalidated anyway when it is loaded. Indexes may
+  be loaded by any thread, the watcher is only touched in the manager's.
+*/
+void XdgIconManagerPrivate::themeLoaded(const XdgIconThemePrivate *theme)
+{
+	QMutexLocker locker(&lock);
+	loadedThemes << theme;
+	if (loadedThemes.size() == 1)
+		QMetaObject::invokeMethod(q, "_q_watchLoaded", Qt::QueuedConnection);
+}
+
+void XdgIconManagerPrivate::_q_watchLoaded()
+{
+	QMutexLocker locker(&lock);
+	QList<const XdgIconThemePrivate *> themes = loadedThemes;
+	loadedThemes.clear();
+	if (!watcher)
+		return;
+	foreach (const XdgIconThemePrivate *theme, themes)
+		watchPaths(theme->watchPaths());
+}
+
+void XdgIconManagerPrivate::watchPaths(const QStringList &paths)
+{
+	QSet<QString> watched = QSet<QString>::fromList(watcher->directories() + watcher->files());
+	QStringList newPaths;
+	foreach (const QString &path, paths) {
+		if (!watched.contains(path))
+			newPaths << path;
+	}
+	if (!newPaths.isEmpty())
+		watcher->addPaths(newPaths);
+}
+
+/*
+  Existing configuration files the theme choosers read the theme from.
+*/
+QStringList XdgIconManagerPrivate::configFiles()
+{
+	QStringList result;
+	foreach (const QString &file, xdgThemeConfigFiles()) {
+		if (QFile::exists(file))
+			result << file;
+	}
+	return result;
+}
+
+void XdgIconManagerPrivate::_q_pathChanged(const QString &path)
+{
+	changedPaths.insert(path);
+	updateTimer->start();
+}
+
+void XdgIconManagerPrivate::_q_update()
+{
+	QMutexLocker locker(&lock);
+	QSet<QString> paths = changedPaths;
+	changedPaths.clear();
+	bool changed = false;
+	QStringList config = configFiles();
+	QSet<XdgIconTheme *> dirty;
+
+	foreach (const QString &path, paths) {
+		if (config.contains(path)) {
+			defaultThemeId.clear();
+			if (!customTheme) {
+				currentTheme = 0;
+				generation.ref();
+			}
+			changed = true;
+			continue;
+		}
+		foreach (const QDir &dir, basedirs) {
+			QString base = dir.absolutePath();
+			if (path == base) {
+				changed |= loadThemes();
+				break;
+			}
+			if (path.startsWith(base + QLatin1Char('/'))) {
+				QString id = path.mid(base.size() + 1).section(QLatin1Char('/'), 0, 0);
+				XdgIconTheme *theme = themeIdMap.value(id);
+				if (theme && theme->id() == id)
+					dirty << theme;
+				break;
+			}
+		}
+	}
+
+	foreach (XdgIconTheme *theme, dirty) {
+		if (theme->p->updateIndex()) {
+			watchPaths(theme->p->watchPaths());
+			changed = true;
+		}
+	}
+	// Config files replaced by a rename are dropped from the watcher
+	watchPaths(config);
+	if (manifestDirty)
+		saveManifest();
+	locker.unlock();
+
+	if (changed)
+		emit q->changed();
+}
+
+#include "xdgiconmanager.moc"
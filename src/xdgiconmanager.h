@@ -21,9 +21,12 @@
 
 #include <QtCore/QHash>
 #include <QtCore/QMap>
+#include <QtCore/QObject>
 #include <QtCore/QRegExp>
 #include <QtCore/QSharedData>
 #include "xdgicontheme.h"
+#include "xdgiconhandle.h"
+#include "xdgiconprefetch.h"
 #include "xdgthemechooser.h"
 #include "xdgexport.h"
 
@@ -36,12 +39,25 @@ class XdgIconManagerPrivate;
   created, it scans the directories for available themes, and then allows
   querying themes (<code>XdgIconTheme</code> objects) by name or string
   identifier, or getting the system default theme.
+
+  Optionally the manager can watch the icon directories and the desktop
+  settings, see <code>setWatching()</code>.
 */
-class XDG_API XdgIconManager
+class XDG_API XdgIconManager : public QObject
 {
+	Q_OBJECT
 	Q_DISABLE_COPY(XdgIconManager)
 public:
-    XdgIconManager(const QList<QDir> &appDirs = QList<QDir>());
+	/**
+	  Where <code>updateCache()</code> writes the cache of a theme.
+	*/
+	enum CacheLocation
+	{
+		UserCache,   ///< The per-user cache, in the cache home
+		SystemCache  ///< A cache next to the theme, read by all users
+	};
+
+    XdgIconManager(const QList<QDir> &appDirs = QList<QDir>(), QObject *parent = 0);
     virtual ~XdgIconManager();
 
     void clearRules();
@@ -51,18 +67,51 @@ public:
 	const XdgIconTheme *currentTheme() const;
     const XdgIconTheme *themeByName(const QString &themeName) const;
     const XdgIconTheme *themeById(const QString &themeId) const;
+    XdgIconHandle iconHandle(const QString &iconName) const;
 	
 #ifdef QT_GUI_LIB
     /**
       Returns an icon with the specified name (e.g. "document-new").
     */
     inline QIcon getIcon(const QString &iconName) const
-    { return XdgIcon(iconName, QString(), this); }
+    { return XdgIcon(iconHandle(iconName)); }
+
+	XdgIconPrefetch prefetch(const QStringList &iconNames, const QList<uint> &sizes,
+	                         const QList<QIcon::Mode> &modes = QList<QIcon::Mode>() << QIcon::Normal) const;
 #endif	
 
     QStringList themeNames(bool showHidden = false) const;
     QStringList themeIds(bool showHidden = false) const;
+
+	void setWatching(bool watch);
+	bool isWatching() const;
+	void setRuntimeCacheEnabled(bool enable);
+	bool isRuntimeCacheEnabled() const;
+	void setAsyncDecoding(bool enable);
+	bool isAsyncDecoding() const;
+	bool updateCache(const QString &themeId, CacheLocation location = UserCache);
+
+signals:
+	/**
+	  Emitted after icons were added or removed, themes were installed or
+	  the desktop icon theme setting changed. Only emitted in watching mode.
+	*/
+	void changed();
+
+	/**
+	  Emitted in asynchronous decoding mode once the pixmap of an icon at
+	  the size has been decoded. Views which painted the icon before, with
+	  a placeholder, should paint it again.
+	*/
+	void iconDecoded(const QString &iconName, uint size);
+
 private:
+	Q_PRIVATE_SLOT(d, void _q_pathChanged(const QString &))
+	Q_PRIVATE_SLOT(d, void _q_update())
+	Q_PRIVATE_SLOT(d, void _q_watchLoaded())
+	friend class XdgIconThemePrivate;
+	friend class XdgIconHandle;
+	friend class XdgIconDecodeQueue;
     XdgIconManagerPrivate *d;
 };
 
@@ -21,7 +21,13 @@
 
 #include "xdgiconmanager.h"
 #include "xdgicontheme_p.h"
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QMutex>
 #include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
 
 /**
   @private
@@ -31,34 +37,57 @@ inline uint qHash(const QRegExp &regexp)
 
 /**
   @private
+
+  The theme maps are guarded by <code>lock</code>, which is recursive since
+  loading a theme loads its parents. The current theme and the generation
+  are atomic, so lookups read them without locking.
 */
 class XdgIconManagerPrivate
 {
 public:
-    XdgIconManagerPrivate(XdgIconManager *qp) : q(qp), currentTheme(0) {}
+    XdgIconManagerPrivate(XdgIconManager *qp)
+        : q(qp), lock(QMutex::Recursive), allThemesLoaded(false), manifestDirty(false), loadDepth(0), generation(0), currentTheme(0), customTheme(false), asyncDecoding(false), watcher(0), updateTimer(0) {}
     ~XdgIconManagerPrivate();
 	XdgIconManager *q;
+	mutable QMutex lock;
     QHash<QRegExp, XdgThemeChooser> rules;
+    mutable QMap<QString, QString> themeFiles;
     mutable QMap<QString, XdgIconTheme *> themes;
     mutable QMap<QString, XdgIconTheme *> themeIdMap;
-	mutable const XdgIconTheme *currentTheme;
+    mutable bool allThemesLoaded;
+    mutable QMap<QString, QByteArray> records;
+    QList<quint32> basedirStamps;
+    mutable bool manifestDirty;
+    mutable int loadDepth;
+    mutable QAtomicInt generation;
+	mutable QAtomicPointer<const XdgIconTheme> currentTheme;
+	mutable QString defaultThemeId;
+	QAtomicInt runtimeCache;
+	bool customTheme;
+	bool asyncDecoding;
+	QVector<QDir> basedirs;
+	QFileSystemWatcher *watcher;
+	QTimer *updateTimer;
+	QSet<QString> changedPaths;
+	QList<const XdgIconThemePrivate *> loadedThemes;
 
     void init(const QList<QDir> &appDirs);
+	bool loadThemes();
+	XdgIconTheme *loadTheme(const QString &id) const;
+	void resolveParents(XdgIconTheme *theme) const;
+	void loadAllThemes() const;
+	static QString cacheDir();
+	QString runtimeCacheDir() const;
+	static QString manifestPath();
+	bool loadManifest();
+	void saveManifest() const;
+	QString detectTheme() const;
+	void themeLoaded(const XdgIconThemePrivate *theme);
+	void watchPaths(const QStringList &paths);
+	static QStringList configFiles();
+	void _q_pathChanged(const QString &path);
+	void _q_update();
+	void _q_watchLoaded();
 };
 
-XdgIconManagerPrivate::~XdgIconManagerPrivate()
-{
-    // There sometimes equal values for different keys, i.e. because of fallback
-//    QSet<XdgIconData *> allData;
-//    foreach (XdgIconTheme *theme, themes)
-//        allData |= QSet<XdgIconData *>::fromList(theme->p->cache.values());
-//    qDeleteAll(allData);
-
-    // FIXME: May be it will be better to carry all XdgIconTheme's in some list?..
-    QSet<XdgIconTheme *> allThemes;
-    allThemes |= QSet<XdgIconTheme *>::fromList(allThemes.values());
-    allThemes |= QSet<XdgIconTheme *>::fromList(themeIdMap.values());
-    qDeleteAll(allThemes);
-}
-
 #endif // XDGICONMANAGER_P_H
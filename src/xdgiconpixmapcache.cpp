@@ -0,0 +1,268 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include "xdgiconpixmapcache_p.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	// Same as the default of QPixmapCache
+	const int defaultLimit = 10240;
+
+	// Sizes findNearest() looks for, the usual sizes of theme dirs
+	const quint32 commonSizes[] = { 16, 22, 24, 32, 48, 64, 96, 128, 256 };
+	const int commonSizeCount = sizeof(commonSizes) / sizeof(commonSizes[0]);
+}
+
+Q_GLOBAL_STATIC(XdgIconPixmapCache, pixmapCache)
+
+XdgIconPixmapCache::XdgIconPixmapCache()
+	: m_hand(0), m_cost(0), m_limit(defaultLimit), m_hits(0), m_misses(0), m_evictions(0)
+{
+}
+
+XdgIconPixmapCache *XdgIconPixmapCache::instance()
+{
+	return pixmapCache();
+}
+
+/**
+  Fills in the identity of the file, following symlinks. Size, mode and
+  palette are left to the caller. Returns false if there is no such file.
+*/
+bool XdgIconPixmapCache::fileKey(const QString &path, XdgIconFileKey *key)
+{
+#ifdef Q_OS_UNIX
+	struct stat st;
+	if (::stat(QFile::encodeName(path).constData(), &st) != 0)
+		return false;
+	key->device = quint64(st.st_dev);
+	key->inode = quint64(st.st_ino);
+	key->mtime = qint64(st.st_mtime);
+#else
+	QFileInfo info(path);
+	QByteArray canonical = info.canonicalFilePath().toUtf8();
+	if (canonical.isEmpty())
+		return false;
+	// FNV-1a, 64 bits keep collisions out of reach
+	quint64 hash = Q_UINT64_C(14695981039346656037);
+	for (int i = 0; i < canonical.size(); i++) {
+		hash ^= uchar(canonical.at(i));
+		hash *= Q_UINT64_C(1099511628211);
+	}
+	key->device = 0;
+	key->inode = hash;
+	key->mtime = info.lastModified().toTime_t();
+#endif
+	return true;
+}
+
+/**
+  Looks the pixmap up, and marks it as recently used if it is found. The
+  file it was read from is stored in <code>file</code>, if given.
+*/
+bool XdgIconPixmapCache::find(const XdgIconPixmapKey &key, QPixmap *pixmap, XdgIconFileKey *file)
+{
+	QHash<XdgIconPixmapKey, int>::const_iterator it = m_keys.constFind(key);
+	if (it == m_keys.constEnd())
+		return false;
+	Slot &slot = m_slots[it.value()];
+	slot.referenced = true;
+	*pixmap = slot.pixmap;
+	if (file)
+		*file = slot.file;
+	m_hits++;
+	return true;
+}
+
+/**
+  Looks up the pixmap read from a file, under whatever key it was stored.
+*/
+bool XdgIconPixmapCache::find(const XdgIconFileKey &file, QPixmap *pixmap)
+{
+	QHash<XdgIconFileKey, int>::const_iterator it = m_files.constFind(file);
+	if (it == m_files.constEnd())
+		return false;
+	Slot &slot = m_slots[it.value()];
+	slot.referenced = true;
+	*pixmap = slot.pixmap;
+	m_hits++;
+	return true;
+}
+
+/**
+  Looks for a pixmap of the same icon and mode at one of the common sizes,
+  the closest to the size of the key. It doesn't count as a hit, the
+  pixmap is only good for a placeholder.
+*/
+bool XdgIconPixmapCache::findNearest(const XdgIconPixmapKey &key, QPixmap *pixmap) const
+{
+	XdgIconPixmapKey other = key;
+	quint32 minDistance = 0;
+	int found = -1;
+	for (int i = 0; i < commonSizeCount; i++) {
+		other.size = commonSizes[i];
+		QHash<XdgIconPixmapKey, int>::const_iterator it = m_keys.constFind(other);
+		if (it == m_keys.constEnd())
+			continue;
+		quint32 distance = other.size > key.size ? other.size - key.size : key.size - other.size;
+		if (found < 0 || distance < minDistance) {
+			minDistance = distance;
+			found = it.value();
+		}
+	}
+	if (found < 0)
+		return false;
+	*pixmap = m_slots.at(found).pixmap;
+	return true;
+}
+
+/**
+  Makes the key lead to the pixmap of the file. If the file has a pixmap
+  already, that one is kept and the given one is dropped. Pixmaps larger
+  than the whole limit are not kept.
+*/
+void XdgIconPixmapCache::insert(const XdgIconPixmapKey &key, const XdgIconFileKey &file, const QPixmap &pixmap)
+{
+	unlink(key);
+	QHash<XdgIconFileKey, int>::const_iterator it = m_files.constFind(file);
+	if (it != m_files.constEnd()) {
+		m_slots[it.value()].keys.append(key);
+		m_keys.insert(key, it.value());
+		return;
+	}
+	m_misses++;
+	int cost = (pixmap.width() * pixmap.height() * pixmap.depth() / 8 + 1023) / 1024;
+	if (pixmap.isNull() || cost > m_limit)
+		return;
+	while (m_cost + cost > m_limit)
+		evict();
+	int index;
+	if (m_free.isEmpty()) {
+		index = m_slots.size();
+		m_slots.resize(index + 1);
+	} else {
+		index = m_free.last();
+		m_free.resize(m_free.size() - 1);
+	}
+	Slot &slot = m_slots[index];
+	slot.file = file;
+	slot.keys.append(key);
+	slot.pixmap = pixmap;
+	slot.cost = cost;
+	// New pixmaps have to be used again to survive the next sweep
+	slot.referenced = false;
+	m_keys.insert(key, index);
+	m_files.insert(file, index);
+	m_cost += cost;
+}
+
+void XdgIconPixmapCache::clear()
+{
+	m_keys.clear();
+	m_files.clear();
+	m_slots.clear();
+	m_free.clear();
+	m_hand = 0;
+	m_cost = 0;
+}
+
+/**
+  Sets the size of the cache in kilobytes, and evicts pixmaps until they
+  fit into it.
+*/
+void XdgIconPixmapCache::setLimit(int kilobytes)
+{
+	m_limit = qMax(0, kilobytes);
+	while (m_cost > m_limit)
+		evict();
+}
+
+int XdgIconPixmapCache::limit() const
+{
+	return m_limit;
+}
+
+XdgIcon::CacheStatistics XdgIconPixmapCache::statistics() const
+{
+	XdgIcon::CacheStatistics result;
+	result.hits = m_hits;
+	result.misses = m_misses;
+	result.evictions = m_evictions;
+	result.cost = m_cost;
+	return result;
+}
+
+// A key may have led to the pixmap of another file, if the icon changed
+void XdgIconPixmapCache::unlink(const XdgIconPixmapKey &key)
+{
+	QHash<XdgIconPixmapKey, int>::iterator it = m_keys.find(key);
+	if (it == m_keys.end())
+		return;
+	QVector<XdgIconPixmapKey> &keys = m_slots[it.value()].keys;
+	for (int i = 0; i < keys.size(); i++) {
+		if (keys.at(i) == key) {
+			keys.remove(i);
+			break;
+		}
+	}
+	m_keys.erase(it);
+}
+
+/*
+  Moves the hand on to the first slot which was not used since the hand
+  passed it last, clearing the flags on the way, and drops its pixmap.
+  Only called while some slot holds a pixmap.
+*/
+void XdgIconPixmapCache::evict()
+{
+	for (;;) {
+		if (m_hand >= m_slots.size())
+			m_hand = 0;
+		Slot &slot = m_slots[m_hand++];
+		if (!slot.cost)
+			continue;
+		if (slot.referenced) {
+			slot.referenced = false;
+			continue;
+		}
+		release(m_hand - 1);
+		m_evictions++;
+		return;
+	}
+}
+
+void XdgIconPixmapCache::release(int index)
+{
+	Slot &slot = m_slots[index];
+	foreach (const XdgIconPixmapKey &key, slot.keys)
+		m_keys.remove(key);
+	m_files.remove(slot.file);
+	m_cost -= slot.cost;
+	slot.keys.clear();
+	slot.pixmap = QPixmap();
+	slot.cost = 0;
+	m_free.append(index);
+}
@@ -0,0 +1,151 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef XDGICONPIXMAPCACHE_P_H
+#define XDGICONPIXMAPCACHE_P_H
+
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <QtGui/QPixmap>
+#include "xdgicon.h"
+
+/**
+  @private
+
+  Identifies a pixmap of an icon: the icon of a theme index, identified by
+  the index serial, at one size and in one mode. Generated pixmaps of the
+  other modes depend on the palette too, normal ones have 0 there.
+*/
+struct XdgIconPixmapKey
+{
+	quint32 index;
+	qint32 icon;
+	quint32 size;
+	qint32 mode;
+	qint64 palette;
+};
+
+/**
+  @private
+
+  Identifies a pixmap by the file it was read from, whatever theme, name
+  or symlink it was reached through: the device and inode of the file, or
+  a hash of its canonical path where there are no inodes, and its
+  modification time. Size, mode and palette are those of the pixmap key.
+*/
+struct XdgIconFileKey
+{
+	quint64 device;
+	quint64 inode;
+	qint64 mtime;
+	quint32 size;
+	qint32 mode;
+	qint64 palette;
+};
+
+inline bool operator==(const XdgIconPixmapKey &a, const XdgIconPixmapKey &b)
+{
+	return a.index == b.index && a.icon == b.icon && a.size == b.size
+	        && a.mode == b.mode && a.palette == b.palette;
+}
+
+inline uint qHash(const XdgIconPixmapKey &key)
+{
+	uint hash = key.index;
+	hash = hash * 31 + uint(key.icon);
+	hash = hash * 31 + key.size;
+	hash = hash * 31 + uint(key.mode);
+	return hash ^ uint(key.palette) ^ uint(quint64(key.palette) >> 32);
+}
+
+inline bool operator==(const XdgIconFileKey &a, const XdgIconFileKey &b)
+{
+	return a.inode == b.inode && a.device == b.device && a.mtime == b.mtime
+	        && a.size == b.size && a.mode == b.mode && a.palette == b.palette;
+}
+
+inline uint qHash(const XdgIconFileKey &key)
+{
+	uint hash = uint(key.inode) ^ uint(key.inode >> 32);
+	hash = hash * 31 + uint(key.device) + uint(key.mtime);
+	hash = hash * 31 + key.size;
+	hash = hash * 31 + uint(key.mode);
+	return hash ^ uint(key.palette) ^ uint(quint64(key.palette) >> 32);
+}
+
+/**
+  @private
+
+  Pixmaps of themed icons, kept apart from <code>QPixmapCache</code> so
+  they neither push out the application's pixmaps nor get pushed out by
+  them. The cache holds at most <code>limit()</code> kilobytes of pixmaps
+  and evicts with the CLOCK algorithm: a hit only sets the referenced flag
+  of the slot, and the hand sweeping the slots gives every referenced
+  pixmap a second chance before dropping it.
+
+  Every pixmap is stored once per file it was read from. Themes inherit
+  each other's icons and link them under several names, so a slot has a
+  list of pixmap keys which lead to it; looking one of those up doesn't
+  allocate nor touch the file system. Only for a key which is not known
+  yet the file has to be identified.
+
+  Pixmaps belong to the GUI thread, and so does the cache.
+*/
+class XdgIconPixmapCache
+{
+public:
+	XdgIconPixmapCache();
+
+	static XdgIconPixmapCache *instance();
+	static bool fileKey(const QString &path, XdgIconFileKey *key);
+
+	bool find(const XdgIconPixmapKey &key, QPixmap *pixmap, XdgIconFileKey *file = 0);
+	bool find(const XdgIconFileKey &file, QPixmap *pixmap);
+	bool findNearest(const XdgIconPixmapKey &key, QPixmap *pixmap) const;
+	void insert(const XdgIconPixmapKey &key, const XdgIconFileKey &file, const QPixmap &pixmap);
+	void clear();
+	void setLimit(int kilobytes);
+	int limit() const;
+	XdgIcon::CacheStatistics statistics() const;
+
+private:
+	struct Slot
+	{
+		XdgIconFileKey file;
+		QVector<XdgIconPixmapKey> keys;
+		QPixmap pixmap;
+		int cost;
+		bool referenced;
+	};
+	void unlink(const XdgIconPixmapKey &key);
+	void evict();
+	void release(int slot);
+	QHash<XdgIconPixmapKey, int> m_keys;
+	QHash<XdgIconFileKey, int> m_files;
+	QVector<Slot> m_slots;
+	QVector<int> m_free;
+	int m_hand;
+	int m_cost;
+	int m_limit;
+	quint64 m_hits;
+	quint64 m_misses;
+	quint64 m_evictions;
+};
+
+#endif // XDGICONPIXMAPCACHE_P_H
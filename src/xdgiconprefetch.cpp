@@ -0,0 +1,85 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "xdgiconprefetch.h"
+#include "xdgicondecoder_p.h"
+
+/**
+  Creates a finished prefetch of no icons.
+*/
+XdgIconPrefetch::XdgIconPrefetch() : d(new XdgIconPrefetchData)
+{
+}
+
+// Out of line, the data is not known outside of the library
+XdgIconPrefetch::XdgIconPrefetch(const XdgIconPrefetch &other) : d(other.d)
+{
+}
+
+XdgIconPrefetch::~XdgIconPrefetch()
+{
+}
+
+XdgIconPrefetch &XdgIconPrefetch::operator=(const XdgIconPrefetch &other)
+{
+	d = other.d;
+	return *this;
+}
+
+/**
+  Returns true once all pixmaps are in the cache, or the prefetch was
+  canceled.
+*/
+bool XdgIconPrefetch::isFinished() const
+{
+	return d->remaining == 0;
+}
+
+bool XdgIconPrefetch::isCanceled() const
+{
+	return d->canceled;
+}
+
+/**
+  Returns the number of files still being decoded.
+*/
+int XdgIconPrefetch::remaining() const
+{
+	return d->remaining;
+}
+
+/**
+  Blocks until all pixmaps are decoded and cached. Other icons decoded
+  meanwhile are cached too.
+*/
+void XdgIconPrefetch::waitForFinished()
+{
+	if (d->remaining > 0)
+		XdgIconDecoder::waitFor(d.data());
+}
+
+/**
+  Stops waiting for the pixmaps not decoded yet. Decodes which started
+  already are finished, but only cached for other requests of the file.
+*/
+void XdgIconPrefetch::cancel()
+{
+	if (!d->canceled)
+		XdgIconDecoder::cancel(d.data());
+}
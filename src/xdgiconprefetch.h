@@ -0,0 +1,57 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef XDGICONPREFETCH_H
+#define XDGICONPREFETCH_H
+
+#include <QtCore/QExplicitlySharedDataPointer>
+#include "xdgexport.h"
+
+class XdgIconPrefetchData;
+
+/**
+  @brief Handle of icons being decoded ahead of time
+
+  Returned by <code>XdgIconManager::prefetch()</code>. The pixmaps are
+  decoded by worker threads and put into the icon pixmap cache as they
+  become ready, while the event loop runs. <code>waitForFinished()</code>
+  takes them all at once instead, and <code>cancel()</code> drops the
+  ones not decoded yet. Copies refer to the same prefetch. Handles must
+  only be used from the GUI thread.
+*/
+class XDG_API XdgIconPrefetch
+{
+public:
+	XdgIconPrefetch();
+	XdgIconPrefetch(const XdgIconPrefetch &other);
+	~XdgIconPrefetch();
+	XdgIconPrefetch &operator=(const XdgIconPrefetch &other);
+
+	bool isFinished() const;
+	bool isCanceled() const;
+	int remaining() const;
+	void waitForFinished();
+	void cancel();
+
+private:
+	friend class XdgIconManager;
+	QExplicitlySharedDataPointer<XdgIconPrefetchData> d;
+};
+
+#endif // XDGICONPREFETCH_H
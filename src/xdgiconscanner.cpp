@@ -0,0 +1,310 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDirIterator>
+#include <QtCore/QRunnable>
+#include <QtCore/QSet>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include "xdgiconscanner_p.h"
+#include "xdgiconindex_p.h"
+#include "xdgicontheme_p.h"
+#include "xdggtkiconcache_p.h"
+
+namespace
+{
+	/*
+	  Scans one directory of a theme. A Cache job covers the whole theme
+	  directory using the GTK+ cache, lists the dirs which changed since
+	  the cache was written as well as the compressed SVG files the cache
+	  can't describe, and falls back to walking it all, a Tree
+	  job walks one top-level subdirectory and a Directory job lists the
+	  files of a single theme dir. Each job stamps the dirs it covers before
+	  listing them. Jobs have their own builder and their own QDir objects,
+	  only the subdirs list is shared read-only.
+	*/
+	class ScanJob : public QRunnable
+	{
+	public:
+		enum Mode { Cache, Tree, Directory };
+
+		ScanJob(const XdgIconDirList &subdirs, const QStringList &basedirs, int basedir,
+		        const QString &themeDir, Mode mode, const QString &path = QString())
+		    : builder(subdirs, basedirs), m_subdirs(subdirs), m_basedir(basedir),
+		      m_themeDir(themeDir), m_mode(mode), m_path(path)
+		{
+			setAutoDelete(false);
+		}
+
+		void run()
+		{
+			QDir themeDir(m_themeDir);
+			if (m_mode == Directory) {
+				stamp(m_path, false);
+				walk(themeDir.filePath(m_path), QDirIterator::NoIteratorFlags);
+				return;
+			}
+			if (m_mode == Cache) {
+				stamp(QString(), true);
+				XdgGtkIconCache gtkCache;
+				if (gtkCache.load(themeDir)) {
+					// Dirs changed since the cache was written are listed instead
+					QList<const XdgIconDir *> stale = gtkCache.staleDirs(m_subdirs, themeDir);
+					if (gtkCache.fill(builder, m_basedir, m_subdirs, themeDir, stale)) {
+						QStringList compressed;
+						compressed << QLatin1String("*.svgz") << QLatin1String("*.svg.gz");
+						foreach (const XdgIconDir &dir, m_subdirs) {
+							if (stale.contains(&dir))
+								walk(themeDir.filePath(dir.path), QDirIterator::NoIteratorFlags);
+							else
+								walk(themeDir.filePath(dir.path), QDirIterator::NoIteratorFlags, compressed);
+						}
+						return;
+					}
+				}
+				walk(m_themeDir, QDirIterator::Subdirectories);
+				return;
+			}
+			stamp(themeDir.relativeFilePath(m_path), true);
+			walk(m_path, QDirIterator::Subdirectories);
+		}
+
+		XdgIconIndexBuilder builder;
+
+	private:
+		void stamp(const QString &dir, bool recursive)
+		{
+			QString prefix = dir + QLatin1Char('/');
+			foreach (const XdgIconDir &subdir, m_subdirs) {
+				if (dir.isEmpty() || subdir.path == dir || (recursive && subdir.path.startsWith(prefix))) {
+					quint32 value = XdgIconScanner::dirStamp(m_themeDir + QLatin1Char('/') + subdir.path);
+					builder.addStamp(XdgIconSource(m_basedir, &subdir), value);
+				}
+			}
+		}
+
+		void walk(const QString &path, QDirIterator::IteratorFlags flags,
+		          const QStringList &nameFilters = QStringList())
+		{
+			QDir themeDir(m_themeDir);
+			QDirIterator it(path, nameFilters, QDir::NoFilter, flags);
+			while (it.hasNext()) {
+				it.next();
+				QFileInfo info = it.fileInfo();
+				if (!info.isFile())
+					continue;
+				QString dirPath = themeDir.relativeFilePath(info.path());
+				// Files in the theme root (index.theme and friends) are never icons
+				if (dirPath.isEmpty() || dirPath == QLatin1String("."))
+					continue;
+				const XdgIconDir *subdir = xdgFindIconDir(m_subdirs, dirPath);
+				if (!subdir) {
+					qWarning("QXdg: \"%s\" is unknown dir", qPrintable(info.absolutePath()));
+					continue;
+				}
+				builder.addEntry(info.baseName(), m_basedir, subdir, info.absoluteFilePath());
+			}
+		}
+
+		const XdgIconDirList &m_subdirs;
+		int m_basedir;
+		QString m_themeDir;
+		Mode m_mode;
+		QString m_path;
+	};
+}
+
+XdgIconScanner::XdgIconScanner(const QString &id, const QVector<QDir> &basedirs,
+                               const XdgIconDirList &subdirs)
+    : m_id(id), m_basedirs(basedirs), m_subdirs(subdirs), m_systemCache(true)
+{
+}
+
+/**
+  Enables or disables taking base directories from their system caches.
+  It is disabled to build these caches.
+*/
+void XdgIconScanner::setSystemCacheEnabled(bool enable)
+{
+	m_systemCache = enable;
+}
+
+/**
+  Returns the absolute paths of the theme directory in every base
+  directory, in the form expected by <code>XdgIconIndexBuilder</code>.
+*/
+QStringList XdgIconScanner::themePaths() const
+{
+	QStringList paths;
+	for (int i = 0; i < m_basedirs.size(); i++)
+		paths << themePath(i);
+	return paths;
+}
+
+/**
+  Compares the stamps recorded in an index with the file system and returns
+  the directories which have to be scanned again. If the theme directory of
+  a base directory itself changed, the whole of it is returned, as new
+  subdirectories might have appeared there.
+*/
+QList<XdgIconSource> XdgIconScanner::staleSources(const QHash<XdgIconSource, quint32> &stamps) const
+{
+	QList<XdgIconSource> sources;
+	for (int i = 0; i < m_basedirs.size(); i++) {
+		QString themeDir = themePath(i);
+		quint32 root = dirStamp(themeDir);
+		quint32 stored = stamps.value(XdgIconSource(i), XdgIconIndex::UnknownStamp);
+		if (stored == XdgIconIndex::UnknownStamp || stored != root) {
+			sources << XdgIconSource(i);
+			continue;
+		}
+		if (root == XdgIconIndex::MissingStamp)
+			continue;
+		foreach (const XdgIconDir &subdir, m_subdirs) {
+			XdgIconSource source(i, &subdir);
+			stored = stamps.value(source, XdgIconIndex::UnknownStamp);
+			if (stored == XdgIconIndex::UnknownStamp || stored != dirStamp(themeDir + QLatin1Char('/') + subdir.path))
+				sources << source;
+		}
+	}
+	return sources;
+}
+
+/**
+  Scans every base directory of the theme.
+*/
+void XdgIconScanner::scan(XdgIconIndexBuilder &builder) const
+{
+	QList<XdgIconSource> sources;
+	for (int i = 0; i < m_basedirs.size(); i++)
+		sources << XdgIconSource(i);
+	scan(builder, sources);
+}
+
+/**
+  Scans the given directories only, as returned by <code>staleSources()</code>.
+*/
+void XdgIconScanner::scan(XdgIconIndexBuilder &builder, const QList<XdgIconSource> &sources) const
+{
+	QStringList basedirs = themePaths();
+	QList<ScanJob *> jobs;
+	foreach (const XdgIconSource &source, sources) {
+		QString themeDir = themePath(source.basedir);
+		if (source.dir) {
+			jobs << new ScanJob(m_subdirs, basedirs, source.basedir, themeDir, ScanJob::Directory, source.dir->path);
+			continue;
+		}
+		QList<XdgIconSource> changed;
+		if (m_systemCache && copySystemCache(builder, source.basedir, &changed)) {
+			foreach (const XdgIconSource &dir, changed)
+				jobs << new ScanJob(m_subdirs, basedirs, source.basedir, themeDir, ScanJob::Directory, dir.dir->path);
+			continue;
+		}
+		quint32 stamp = dirStamp(themeDir);
+		builder.addStamp(source, stamp);
+		if (stamp == XdgIconIndex::MissingStamp)
+			continue;
+		// Prefer the cache shipped with the theme over walking it
+		if (XdgGtkIconCache::isUpToDate(QDir(themeDir))) {
+			jobs << new ScanJob(m_subdirs, basedirs, source.basedir, themeDir, ScanJob::Cache);
+			continue;
+		}
+		QSet<QString> topDirs;
+		QDirIterator it(themeDir, QDir::Dirs | QDir::NoDotAndDotDot);
+		while (it.hasNext()) {
+			jobs << new ScanJob(m_subdirs, basedirs, source.basedir, themeDir, ScanJob::Tree, it.next());
+			topDirs << it.fileName();
+		}
+		// Dirs which are not there yet must be picked up once they appear
+		foreach (const XdgIconDir &subdir, m_subdirs) {
+			if (!topDirs.contains(subdir.path.section(QLatin1Char('/'), 0, 0)))
+				builder.addStamp(XdgIconSource(source.basedir, &subdir), XdgIconIndex::MissingStamp);
+		}
+	}
+
+	if (jobs.size() > 1 && QThread::idealThreadCount() > 1) {
+		// A private pool, so we don't wait for someone else's tasks
+		QThreadPool pool;
+		pool.setMaxThreadCount(qMin(jobs.size(), QThread::idealThreadCount()));
+		foreach (ScanJob *job, jobs)
+			pool.start(job);
+		pool.waitForDone();
+	} else {
+		foreach (ScanJob *job, jobs)
+			job->run();
+	}
+
+	foreach (ScanJob *job, jobs)
+		builder.merge(job->builder);
+	qDeleteAll(jobs);
+}
+
+/**
+  Returns the modification time of a directory (or file) in seconds. A path
+  modified within the current second gets <code>UnknownStamp</code>, since
+  a later change in the same second would not alter its time; such stamps
+  never match, so the directory is scanned again next time.
+*/
+quint32 XdgIconScanner::dirStamp(const QString &path)
+{
+	QFileInfo info(path);
+	if (!info.exists())
+		return XdgIconIndex::MissingStamp;
+	uint modified = info.lastModified().toTime_t();
+	if (modified >= QDateTime::currentDateTime().toTime_t() || modified >= XdgIconIndex::MissingStamp)
+		return XdgIconIndex::UnknownStamp;
+	return modified;
+}
+
+/**
+  Returns the path of the system cache of a theme in a base directory. It
+  is next to the theme directory rather than in it, so writing it does not
+  change the stamp of the theme directory.
+*/
+QString XdgIconScanner::systemCachePath(const QDir &basedir, const QString &id)
+{
+	return basedir.absoluteFilePath(id + QLatin1String(".qxdg-index"));
+}
+
+/*
+  Takes a base directory from its system cache. Subdirs which changed
+  since the cache was built are returned to be scanned; if the theme
+  directory itself changed, the cache is not used at all.
+*/
+bool XdgIconScanner::copySystemCache(XdgIconIndexBuilder &builder, int basedir, QList<XdgIconSource> *changed) const
+{
+	XdgIconIndex index;
+	if (!index.load(systemCachePath(m_basedirs.at(basedir), m_id))
+	        || !index.attach(m_subdirs, QStringList(themePath(basedir))))
+		return false;
+	XdgIconScanner single(m_id, QVector<QDir>(1, m_basedirs.at(basedir)), m_subdirs);
+	QList<XdgIconSource> stale = single.staleSources(index.stamps());
+	foreach (const XdgIconSource &source, stale) {
+		if (!source.dir)
+			return false;
+	}
+	index.copyTo(builder, stale, basedir);
+	*changed = stale;
+	return true;
+}
+
+QString XdgIconScanner::themePath(int basedir) const
+{
+	return m_basedirs.at(basedir).absoluteFilePath(m_id);
+}
@@ -0,0 +1,70 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef XDGICONSCANNER_P_H
+#define XDGICONSCANNER_P_H
+
+#include <QtCore/QDir>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include "xdgiconindex_p.h"
+
+/**
+  @private
+
+  Fills an index builder with the icon files of a theme. The work is split
+  into one job per base directory and per top-level subdirectory, which run
+  on a thread pool and build partial indexes. These are merged in the order
+  of the base directories and of the subdirectory listing, so the result is
+  the same as a serial walk.
+
+  Every scanned directory is stamped with its modification time, taken
+  before it is listed. <code>staleSources()</code> compares these stamps
+  with the file system, so only directories which changed since have to
+  be scanned again.
+
+  A base directory may have a prebuilt system cache next to the theme,
+  written by <code>qxdg-update-cache --system</code>. It is used in place
+  of a scan as long as it was built for the same directories.
+*/
+class XdgIconScanner
+{
+public:
+	XdgIconScanner(const QString &id, const QVector<QDir> &basedirs, const XdgIconDirList &subdirs);
+
+	QStringList themePaths() const;
+	QList<XdgIconSource> staleSources(const QHash<XdgIconSource, quint32> &stamps) const;
+	void scan(XdgIconIndexBuilder &builder) const;
+	void scan(XdgIconIndexBuilder &builder, const QList<XdgIconSource> &sources) const;
+	void setSystemCacheEnabled(bool enable);
+
+	static quint32 dirStamp(const QString &path);
+	static QString systemCachePath(const QDir &basedir, const QString &id);
+
+private:
+	QString themePath(int basedir) const;
+	bool copySystemCache(XdgIconIndexBuilder &builder, int basedir, QList<XdgIconSource> *changed) const;
+	QString m_id;
+	QVector<QDir> m_basedirs;
+	const XdgIconDirList &m_subdirs;
+	bool m_systemCache;
+};
+
+#endif // XDGICONSCANNER_P_H
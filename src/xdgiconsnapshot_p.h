@@ -0,0 +1,91 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef XDGICONSNAPSHOT_P_H
+#define XDGICONSNAPSHOT_P_H
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QExplicitlySharedDataPointer>
+#include <QtCore/QThread>
+
+/**
+  @private
+
+  Publishes immutable snapshots (<code>QSharedData</code> subclasses) to
+  any number of reader threads. Readers never lock: <code>load()</code>
+  takes a reference on the current snapshot, which stays valid for as long
+  as the reader holds it, whatever writers do meanwhile.
+
+  Writers have to be serialized by the owner. <code>store()</code> swaps
+  the pointer and then waits for a grace period, until no reader which
+  started before the swap is in the middle of taking its reference, before
+  it drops the reference of the slot on the old snapshot. Readers count
+  themselves in one of two counters, picked by the current epoch. A reader
+  may be held up between picking the counter and counting itself, so
+  <code>store()</code> flips the epoch twice and drains the counter left
+  behind after each flip: both counters are then known to be free of
+  readers older than the swap, while readers coming later use the other
+  counter and never keep a writer waiting. The old snapshot is deleted by
+  whoever releases it last.
+*/
+template <typename T>
+class XdgIconSnapshotSlot
+{
+	Q_DISABLE_COPY(XdgIconSnapshotSlot)
+public:
+	inline XdgIconSnapshotSlot() {}
+	inline ~XdgIconSnapshotSlot() { release(m_current.fetchAndStoreOrdered(0)); }
+
+	inline QExplicitlySharedDataPointer<T> load() const
+	{
+		QAtomicInt &readers = m_readers[int(m_epoch) & 1];
+		readers.ref();
+		QExplicitlySharedDataPointer<T> snapshot(static_cast<T *>(m_current));
+		readers.deref();
+		return snapshot;
+	}
+
+	void store(T *snapshot)
+	{
+		if (snapshot)
+			snapshot->ref.ref();
+		T *old = m_current.fetchAndStoreOrdered(snapshot);
+		for (int i = 0; i < 2; i++) {
+			int epoch = int(m_epoch) & 1;
+			m_epoch.fetchAndStoreOrdered(epoch ^ 1);
+			// The window between reading the pointer and taking the reference is a few instructions
+			while (m_readers[epoch] != 0)
+				QThread::yieldCurrentThread();
+		}
+		release(old);
+	}
+
+private:
+	static inline void release(T *snapshot)
+	{
+		if (snapshot && !snapshot->ref.deref())
+			delete snapshot;
+	}
+	QAtomicPointer<T> m_current;
+	mutable QAtomicInt m_readers[2];
+	QAtomicInt m_epoch;
+};
+
+#endif // XDGICONSNAPSHOT_P_H
@@ -17,79 +17,179 @@
 */
 
 #include <limits>
-#include <QtCore/QSettings>
+#include <stdio.h>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
 #include <QtCore/QSet>
 #include <QtCore/QDirIterator>
-#include <QtCore/QDateTime>
-#include <QtCore/QDataStream>
+#include <QtCore/QTemporaryFile>
 #include <QtCore/QVector>
 #include "xdgicontheme_p.h"
+#include "xdgiconcachelock_p.h"
+#include "xdgiconscanner_p.h"
+#include "xdgiconmanager_p.h"
+#include "xdgiconthemefile_p.h"
 #include "xdgicon.h"
-#include "xdgenvironment.h"
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
 
 namespace
 {
     const char *exts[] = { ".png", ".svg", ".svgz", ".svg.gz", ".xpm" };
     const int extCount = sizeof(exts) / sizeof(char *);
+
+	// How long a process waits for another one rebuilding the same index
+	const int cacheLockTimeout = 3000;
+
+	/*
+	  Stamps have a resolution of a second and a dir modified within the
+	  current one gets none, see XdgIconScanner::dirStamp().
+	*/
+	void waitForNextSecond()
+	{
+#ifdef Q_OS_UNIX
+		::usleep((1000 - QTime::currentTime().msec() + 10) * 1000);
+#endif
+	}
+
+	void copyCache(const QString &from, const QString &to)
+	{
+		QFile file(from);
+		if (file.open(QIODevice::ReadOnly))
+			XdgIconThemePrivate::writeCache(to, file.readAll());
+	}
 }
 
-const XdgIconEntry *XdgIconData::findEntry(uint size) const
+/**
+  Looks the icon up in the theme and its parents, through the merged index
+  of the inheritance chain. Names which are not found are remembered until
+  any index of the manager changes, so probing for a missing icon over and
+  over costs a single hash lookup. Safe to call from any thread.
+*/
+XdgIconData XdgIconThemePrivate::findIcon(const QString &name) const
 {
-    if (entries.isEmpty())
-        return 0;
+	if (isMiss(name))
+		return XdgIconData();
+	QExplicitlySharedDataPointer<XdgIconMergedSnapshot> snapshot = ensureMergedIndex();
+	int theme, icon;
+	if (snapshot->merged.find(QStringRef(&name), &theme, &icon))
+		return XdgIconData(snapshot->chain.at(theme), icon);
+	addMiss(name, snapshot->generation);
+	return XdgIconData();
+}
 
-    // Look for an exact size match first, per specification
-    for (int i = 0; i < entries.size(); i++) {
-        if (XdgIconThemePrivate::dirMatchesSize(*entries[i].dir, size)) {
-            return &entries[i];
-        }
-    }
+bool XdgIconThemePrivate::isMiss(const QString &name) const
+{
+	if (!missLock.tryLock())
+		return false;
+	if (missGeneration != generation())
+		clearMisses();
+	bool miss = misses.contains(name);
+	missLock.unlock();
+	return miss;
+}
 
-    // Then find the closest size
-    uint mindist = 0;
-    const XdgIconEntry *entry = 0;
-    for (int i = 0; i < entries.size(); i++) {
-        uint distance = XdgIconThemePrivate::dirSizeDistance(*entries[i].dir, size);
+/*
+  A miss seen in an older snapshot than the current generation is not
+  remembered, the newer indexes may have the icon.
+*/
+void XdgIconThemePrivate::addMiss(const QString &name, uint seenGeneration) const
+{
+	if (!missLock.tryLock())
+		return;
+	if (missGeneration != generation())
+		clearMisses();
+	if (missGeneration == seenGeneration) {
+		if (missOrder.size() >= maxMisses)
+			misses.remove(missOrder.dequeue());
+		misses.insert(name);
+		missOrder.enqueue(name);
+	}
+	missLock.unlock();
+}
 
-        if (!entry || distance < mindist) {
-            mindist = distance;
-            entry = &entries[i];
-        }
-    }
+// Called with missLock held
+void XdgIconThemePrivate::clearMisses() const
+{
+	misses.clear();
+	missOrder.clear();
+	missGeneration = generation();
+}
 
-    return entry;
+uint XdgIconThemePrivate::generation() const
+{
+	return manager ? uint(int(manager->d->generation)) : 0;
 }
 
-XdgIconData *XdgIconThemePrivate::findIcon(const QString &name) const
+/**
+  Appends the theme and its ancestors in lookup order: the theme itself,
+  then each parent with its own ancestors. Themes reachable twice are
+  only searched the first time.
+*/
+void XdgIconThemePrivate::collectChain(XdgIconThemeSet &themeSet) const
 {
-	QList<const XdgIconThemePrivate*> themeSet;
-	return lookupIconRecursive(name, themeSet);
+	for (int i = 0; i < themeSet.size(); i++) {
+		if (themeSet.at(i) == this)
+			return;
+	}
+	themeSet.append(this);
+	foreach (const XdgIconTheme *parent, parents)
+		parent->d_func()->collectChain(themeSet);
 }
 
-XdgIconData *XdgIconThemePrivate::lookupIconRecursive(const QString &originName,
-                                                      QList<const XdgIconThemePrivate*> &themeSet) const
+/**
+  Returns the merged index for the current indexes of the chain. It is
+  taken from the cache if it was built for the same indexes, otherwise
+  built and saved again. Only one thread builds it, the others wait for
+  that one and share the result. The manager lock is only held to collect
+  the chain, so other threads can use the manager while its indexes are
+  built.
+*/
+QExplicitlySharedDataPointer<XdgIconMergedSnapshot> XdgIconThemePrivate::ensureMergedIndex() const
 {
-    if (themeSet.contains(this))
-        return 0;
-    themeSet.append(this);
-    ensureDirectoryMaps();
-	QStringRef iconName(&originName);
-	while (!iconName.isEmpty()) {
-		XdgIconDataHash::Iterator it = icons.find(iconName);
-		if (it != icons.end())
-			return &it.value();
-		int index = originName.lastIndexOf('-', iconName.size() - 1);
-		if (index <= 0)
-			iconName = QStringRef();
-		else
-			iconName = QStringRef(&originName, 0, index);
+	QExplicitlySharedDataPointer<XdgIconMergedSnapshot> current = merged.load();
+	if (current && current->generation == generation())
+		return current;
+	QMutexLocker locker(&mergedLock);
+	current = merged.load();
+	if (current && current->generation == generation())
+		return current;
+
+	// Anything changing after this makes the snapshot stale right away
+	uint builtFor = generation();
+	XdgIconThemeSet themeSet;
+	{
+		// Parents are only changed with the manager locked
+		QMutexLocker managerLocker(manager ? &manager->d->lock : 0);
+		collectChain(themeSet);
 	}
-	foreach (const XdgIconTheme *parent, parents) {
-		XdgIconData *data = parent->d_func()->lookupIconRecursive(originName, themeSet);
-		if (data)
-			return data;
+	QExplicitlySharedDataPointer<XdgIconMergedSnapshot> snapshot(new XdgIconMergedSnapshot);
+	QVector<const XdgIconIndex *> chain;
+	for (int i = 0; i < themeSet.size(); i++) {
+		XdgIconIndexRef ref = themeSet.at(i)->ensureDirectoryMaps();
+		snapshot->chain << ref;
+		chain << &ref->index;
+	}
+	XdgIconMergedIndex &mergedIndex = snapshot->merged;
+	if (!mergedIndex.attach(chain)) {
+		QStringList paths = cachePaths(QLatin1String(".merged"));
+		int i = 0;
+		while (i < paths.size() && !(mergedIndex.load(paths.at(i)) && mergedIndex.attach(chain)))
+			i++;
+		if (i == paths.size()) {
+			QByteArray image = XdgIconMergedIndex::build(chain);
+			mergedIndex.load(image);
+			mergedIndex.attach(chain);
+			saveCache(QLatin1String(".merged"), image);
+		} else if (i > 0) {
+			copyCache(paths.at(i), paths.first());
+		}
 	}
-    return 0;
+	snapshot->generation = builtFor;
+	merged.store(snapshot.data());
+	return snapshot;
 }
 
 QString XdgIconThemePrivate::lookupFallbackIcon(const QString &name) const
@@ -108,165 +208,296 @@ QString XdgIconThemePrivate::lookupFallbackIcon(const QString &name) const
     return QString();
 }
 
-bool XdgIconThemePrivate::dirMatchesSize(const XdgIconDir &dir, uint size)
+/*
+  Loads or builds the index on first use. Threads racing for it wait until
+  the first one has published it.
+*/
+XdgIconIndexRef XdgIconThemePrivate::ensureDirectoryMapsHelper() const
+{
+	XdgIconIndexRef current;
+	{
+		QMutexLocker locker(&indexLock);
+		current = index.load();
+		if (current)
+			return current;
+		current = loadIndex();
+		if (current && XdgIconScanner(id, basedirs, subdirs).staleSources(current->index.stamps()).isEmpty())
+			index.store(current.data());
+		else
+			current = rebuildIndex(current);
+	}
+	if (manager)
+		manager->d->themeLoaded(this);
+	return current;
+}
+
+/**
+  Brings the published index up to date. Returns true if it had to be
+  patched; an index which was not loaded yet is left alone.
+*/
+bool XdgIconThemePrivate::updateIndex() const
 {
-    switch (dir.type) {
-    case XdgIconDir::Fixed:
-        return size == dir.size;
-    case XdgIconDir::Scalable:
+	QMutexLocker locker(&indexLock);
+	XdgIconIndexRef current = index.load();
+	if (!current || XdgIconScanner(id, basedirs, subdirs).staleSources(current->index.stamps()).isEmpty())
 		return false;
-//        return (size >= dir.minsize) && (size <= dir.maxsize);
-    case XdgIconDir::Threshold:
-        return (size >= dir.size - dir.threshold) && (size <= dir.size + dir.threshold);
-    }
-    Q_ASSERT(!"New directory type?..");
-    return false;
-}
-
-uint XdgIconThemePrivate::dirSizeDistance(const XdgIconDir &dir, uint size)
-{
-    switch (dir.type) {
-    case XdgIconDir::Fixed:
-        return qAbs(int(dir.size) - int(size));
-    case XdgIconDir::Scalable:
-        if(size < dir.minsize)
-            return dir.minsize - size;
-        if(size > dir.maxsize)
-            return size - dir.maxsize;
-        return 0;
-    case XdgIconDir::Threshold:
-        if(size < dir.size - dir.threshold)
-            return dir.size - dir.threshold - size;
-        if(size > dir.size + dir.threshold)
-            return size - dir.size - dir.threshold;
-        return 0;
-    }
+	rebuildIndex(current);
+	return true;
+}
 
-    Q_ASSERT(!"New directory type?..");
-    return 0;
+/*
+  Returns the index from the first cache which was built for the dirs of
+  the theme, or a null reference. A cache found in the cache home is
+  copied to the runtime dir.
+*/
+XdgIconIndexRef XdgIconThemePrivate::loadIndex() const
+{
+	QStringList themePaths = XdgIconScanner(id, basedirs, subdirs).themePaths();
+	QStringList paths = cachePaths();
+	for (int i = 0; i < paths.size(); i++) {
+		XdgIconIndexRef loaded(new XdgIconIndexSnapshot);
+		if (loaded->index.load(paths.at(i)) && loaded->index.attach(subdirs, themePaths)) {
+			if (i > 0)
+				copyCache(paths.at(i), paths.first());
+			return loaded;
+		}
+	}
+	return XdgIconIndexRef();
 }
 
-void XdgIconThemePrivate::ensureDirectoryMapsHelper() const
+/*
+  Brings a missing or stale index up to date and publishes it. Processes
+  started together would all scan the same theme, so the scan is done
+  with the cache locked: whoever gets the lock after another process
+  finds the cache it wrote, and only reads again what has changed since.
+  If the lock is not released in time the theme is scanned anyway, the
+  cache is replaced atomically either way. Called with indexLock held.
+*/
+XdgIconIndexRef XdgIconThemePrivate::rebuildIndex(XdgIconIndexRef old) const
 {
-	QDir dataDir = XdgEnvironment::dataHome();
-	if (!dataDir.cd(QLatin1String("qxdg"))) {
-		dataDir.mkdir(QLatin1String("qxdg"));
-		dataDir.cd(QLatin1String("qxdg"));
+	XdgIconCacheLock cacheLock(cachePaths().last() + QLatin1String(".lock"));
+	if (cacheLock.lock(cacheLockTimeout)) {
+		XdgIconIndexRef cached = loadIndex();
+		if (cached)
+			old = cached;
 	}
-	QString cachePath = dataDir.filePath(id + QLatin1String(".cache"));
-	QFile file(cachePath);
-	bool ok = false;
-	if (file.exists()) {
-		ok = true;
-		QDateTime checkTime = QFileInfo(cachePath).lastModified();
-		for (int i = 0; ok && i < basedirs.size(); i++) {
-			QFileInfo info = basedirs.at(i).absolutePath();
-			ok &= info.lastModified() <= checkTime;
-		}
-		if (ok && file.open(QIODevice::ReadOnly)) {
-			QDataStream in(&file);
-			in.setVersion(QDataStream::Qt_4_2);
-			int count = 0, entriesCount = 0, len = 0, dirIndex = 0;
-			QString path;
-			in >> count;
-			QVector<const XdgIconDir *> dirs(count);
-			for (int i = 0; ok && i < count; i++) {
-				in >> path;
-				XdgIconDirHash::ConstIterator it = subdirs.constFind(path);
-				ok &= in.status() == QDataStream::Ok && it != subdirs.constEnd();
-				if (ok) dirs[i] = &it.value();
-			}
-			in >> buffer >> count;
-			icons.reserve(count);
-			int index = 0;
-			for (int i = 0; ok && i < count; i++) {
-				in >> index >> len;
-				ok &= in.status() == QDataStream::Ok;
-				QStringRef iconName(&buffer, index, len);
-				XdgIconData data;
-				data.name = iconName;
-				in >> entriesCount;
-				for (int j = 0; ok && j < entriesCount; j++) {
-					in >> path >> dirIndex;
-					ok &= in.status() == QDataStream::Ok;
-					data.entries.append(XdgIconEntry(dirs[dirIndex], path));
-				}
-				icons.insert(iconName, data);
-			}
-			file.close();
+	XdgIconScanner scanner(id, basedirs, subdirs);
+	XdgIconIndexBuilder builder(subdirs, scanner.themePaths());
+	if (old) {
+		QList<XdgIconSource> stale = scanner.staleSources(old->index.stamps());
+		if (stale.isEmpty()) {
+			publishIndex(old);
+			return old;
 		}
+		// Keep what is still valid and read again only the changed dirs
+		old->index.copyTo(builder, stale);
+		scanner.scan(builder, stale);
+	} else {
+		scanner.scan(builder);
 	}
-	if (ok)
-		return;
-	buffer.clear();
-	icons.clear();
-    foreach (const QDir &basedir, basedirs) {
-        QDir dir = basedir;
-        if (!dir.cd(id))
-            continue;
-        QString dirPath = dir.absolutePath();
-        QDirIterator it(dirPath, QDirIterator::Subdirectories);
-        while (it.hasNext()) {
-            it.next();
-			QFileInfo info = it.fileInfo();
-            if (info.isFile()) {
-				QString dirPath = info.path();
-				XdgIconDirHash::ConstIterator dirIt = subdirs.find(dir.relativeFilePath(dirPath));
-				if (dirIt == subdirs.end()) {
-					qWarning("QXdg: \"%s\" is unknown dir", qPrintable(info.absolutePath()));
-					continue;
-				}
-				const XdgIconDir *dir = &dirIt.value();
-				QString name = info.baseName();
-				XdgIconDataHash::Iterator it = icons.find(QStringRef(&name));
-				QString path = info.absoluteFilePath();
-				if (it == icons.end()) {
-					XdgIconData data;
-					QStringRef iconName(&buffer, buffer.size(), name.size());
-					data.name = iconName;
-					buffer.append(name);
-					it = icons.insert(iconName, data);
-				}
-				it.value().entries << XdgIconEntry(dir, path);
-			}
-        }
-    }
-	buffer.squeeze();
-	if (file.open(QIODevice::WriteOnly)) {
-		QDataStream out(&file);
-		out.setVersion(QDataStream::Qt_4_2);
-		QMap<const XdgIconDir*, int> dirsMap;
-		QMapIterator<QString, XdgIconDir> dirIt(subdirs);
-		out << subdirs.size();
-		while (dirIt.hasNext()) {
-			dirIt.next();
-			dirsMap.insert(&dirIt.value(), dirsMap.size());
-			out << dirIt.value().path;
+	return saveIndex(builder);
+}
+
+/*
+  Publishes a new index. Readers still holding the old one keep it until
+  they are done, the generation tells them to look up again.
+*/
+XdgIconIndexRef XdgIconThemePrivate::saveIndex(const XdgIconIndexBuilder &builder) const
+{
+	QByteArray image = builder.build();
+	XdgIconIndexRef snapshot(new XdgIconIndexSnapshot);
+	snapshot->index.load(image);
+	snapshot->index.attach(subdirs, XdgIconScanner(id, basedirs, subdirs).themePaths());
+	publishIndex(snapshot);
+	saveCache(QLatin1String(".index"), image);
+	return snapshot;
+}
+
+void XdgIconThemePrivate::publishIndex(const XdgIconIndexRef &snapshot) const
+{
+	index.store(snapshot.data());
+	if (manager)
+		manager->d->generation.ref();
+}
+
+/**
+  Scans every base directory holding the theme on its own, and writes its
+  system cache next to the theme. A theme which changed within the current
+  second is scanned again in the next one, so its cache gets stamps which
+  match. Returns false if any of them could not be written, or there was
+  none.
+*/
+bool XdgIconThemePrivate::saveSystemCaches() const
+{
+	bool saved = false;
+	foreach (const QDir &basedir, basedirs) {
+		XdgIconScanner scanner(id, QVector<QDir>(1, basedir), subdirs);
+		scanner.setSystemCacheEnabled(false);
+		QStringList themePaths = scanner.themePaths();
+		if (!QFileInfo(themePaths.first()).isDir())
+			continue;
+		// Packages build the cache right after unpacking the theme, when its
+		// dirs get no stamps yet; a cache with such stamps is never used
+		QByteArray image;
+		for (int attempt = 0; attempt < 2; attempt++) {
+			if (attempt > 0)
+				waitForNextSecond();
+			XdgIconIndexBuilder builder(subdirs, themePaths);
+			scanner.scan(builder);
+			image = builder.build();
+			XdgIconIndex index;
+			if (index.load(image) && index.attach(subdirs, themePaths)
+			        && scanner.staleSources(index.stamps()).isEmpty())
+				break;
+			image.clear();
 		}
-		out << buffer << icons.size();
-		XdgIconDataHash::ConstIterator it = icons.constBegin();
-		for (; it != icons.constEnd(); ++it) {
-			out << it.key().position() << it.key().length();
-			const XdgIconData &data = it.value();
-			out << data.entries.size();
-			for (int i = 0; i < data.entries.size(); i++)
-				out << data.entries.at(i).path << dirsMap.value(data.entries.at(i).dir);
+		if (image.isEmpty()) {
+			qWarning("QXdg: \"%s\" keeps changing, its system cache would not be used", qPrintable(themePaths.first()));
+			return false;
 		}
-		file.flush();
+		if (!writeCache(XdgIconScanner::systemCachePath(basedir, id), image))
+			return false;
+		saved = true;
+	}
+	return saved;
+}
+
+/*
+  Never truncate a cache in place, other processes may have it mapped.
+  The image goes to a temporary file of this writer, which is renamed
+  over the cache, so readers see either the old file or the new one.
+*/
+bool XdgIconThemePrivate::writeCache(const QString &path, const QByteArray &image)
+{
+	QTemporaryFile file(path + QLatin1String(".XXXXXX"));
+	if (!file.open())
+		return false;
+	file.setPermissions(QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup | QFile::ReadOther);
+	if (file.write(image) != image.size() || !file.flush())
+		return false;
+	file.setAutoRemove(false);
+	QString temp = file.fileName();
+	file.close();
+#ifdef Q_OS_UNIX
+	if (::rename(QFile::encodeName(temp).constData(), QFile::encodeName(path).constData()) == 0)
+		return true;
+#else
+	QFile::remove(path);
+	if (QFile::rename(temp, path))
+		return true;
+#endif
+	QFile::remove(temp);
+	return false;
+}
+
+/*
+  Paths a cache is read from, in order: the hot copy in the runtime dir if
+  the manager keeps one, then the cache home.
+*/
+QStringList XdgIconThemePrivate::cachePaths(const QString &suffix) const
+{
+	QStringList paths;
+	QString runtime = manager ? manager->d->runtimeCacheDir() : QString();
+	if (!runtime.isEmpty())
+		paths << runtime + QLatin1Char('/') + id + suffix;
+	paths << XdgIconManagerPrivate::cacheDir() + QLatin1Char('/') + id + suffix;
+	return paths;
+}
+
+void XdgIconThemePrivate::saveCache(const QString &suffix, const QByteArray &image) const
+{
+	foreach (const QString &path, cachePaths(suffix))
+		writeCache(path, image);
+}
+
+/**
+  Returns the existing directories of the theme, which have to be watched
+  to keep its index up to date.
+*/
+QStringList XdgIconThemePrivate::watchPaths() const
+{
+	QStringList paths;
+	foreach (QDir dir, basedirs) {
+		if (!dir.cd(id))
+			continue;
+		paths << dir.absolutePath();
+		foreach (const XdgIconDir &subdir, subdirs) {
+			QString path = dir.absoluteFilePath(subdir.path);
+			if (QFileInfo(path).isDir())
+				paths << path;
+		}
+	}
+	return paths;
+}
+
+/**
+  Serializes the parsed theme for the manager manifest.
+*/
+QByteArray XdgIconThemePrivate::saveRecord(const QString &indexFileName) const
+{
+	QByteArray data;
+	QDataStream out(&data, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_4_2);
+	out << indexFileName << stamps << name << localizedName << example << hidden << parentNames << subdirs;
+	return data;
+}
+
+/**
+  Restores the theme from a manifest record instead of parsing its
+  <code>index.theme</code>. Fails if any of the files and dirs the theme
+  was read from has changed since.
+*/
+bool XdgIconThemePrivate::restoreRecord(const QByteArray &data, const QString &indexFileName)
+{
+	QDataStream in(data);
+	in.setVersion(QDataStream::Qt_4_2);
+	QString fileName, recordName, recordLocalizedName, recordExample;
+	QMap<QString, quint32> recordStamps;
+	bool recordHidden = false;
+	QStringList recordParents;
+	XdgIconDirList recordDirs;
+	in >> fileName >> recordStamps >> recordName >> recordLocalizedName >> recordExample >> recordHidden >> recordParents >> recordDirs;
+	if (in.status() != QDataStream::Ok || fileName != indexFileName)
+		return false;
+	QMap<QString, quint32>::const_iterator it = recordStamps.constBegin();
+	for (; it != recordStamps.constEnd(); ++it) {
+		if (it.value() == XdgIconIndex::UnknownStamp || XdgIconScanner::dirStamp(it.key()) != it.value())
+			return false;
 	}
+	stamps = recordStamps;
+	name = recordName;
+	localizedName = recordLocalizedName;
+	example = recordExample;
+	hidden = recordHidden;
+	parentNames = recordParents;
+	subdirs = recordDirs;
+	return true;
 }
 
-void XdgIconDir::fill(QSettings &settings)
+QDataStream &operator<<(QDataStream &out, const XdgIconDir &dir)
+{
+	return out << dir.path << dir.size << qint32(dir.type) << dir.maxsize << dir.minsize << dir.threshold;
+}
+
+QDataStream &operator>>(QDataStream &in, XdgIconDir &dir)
+{
+	qint32 type = 0;
+	in >> dir.path >> dir.size >> type >> dir.maxsize >> dir.minsize >> dir.threshold;
+	if (type < XdgIconDir::Fixed || type > XdgIconDir::Threshold)
+		in.setStatus(QDataStream::ReadCorruptData);
+	dir.type = XdgIconDir::Type(type);
+	return in;
+}
+
+void XdgIconDir::fill(const XdgIconThemeFile &file)
 {
 	// The defaults are dictated by the FDO specification
-	settings.beginGroup(path);
-	size = settings.value(QLatin1String("Size")).toUInt();
-	maxsize = settings.value(QLatin1String("MaxSize"), size).toUInt();
-	minsize = settings.value(QLatin1String("MinSize"), size).toUInt();
-	threshold = settings.value(QLatin1String("Threshold"), 2).toUInt();
-	QString dirType = settings.value(QLatin1String("Type"), QLatin1String("Threshold")).toString();
-	settings.endGroup();
-	
+	size = file.uintValue(path, "Size", 0);
+	maxsize = file.uintValue(path, "MaxSize", size);
+	minsize = file.uintValue(path, "MinSize", size);
+	threshold = file.uintValue(path, "Threshold", 2);
+	QString dirType = file.value(path, "Type", QLatin1String("Threshold"));
+
 	if (dirType == QLatin1String("Fixed"))
         type = XdgIconDir::Fixed;
     else if (dirType == QLatin1String("Scalable"))
@@ -300,42 +531,54 @@ XdgIconTheme::XdgIconTheme(const QVector<QDir> &basedirs, const QString &id, Xdg
     if (indexFileName.isEmpty()) {
         // create an empty theme with defaults
         d->name = id;
+        d->localizedName = id;
         return;
     }
 
-    QSettings settings(indexFileName, QSettings::IniFormat);
+    XdgIconThemeFile file;
+    file.load(indexFileName);
 
-    settings.beginGroup(QLatin1String("Icon Theme"));
-    d->name = settings.value(QLatin1String("Name")).toString();
-    d->example = settings.value(QLatin1String("Example")).toString();
-    d->hidden = settings.value(QLatin1String("Hidden"), false).toBool();
-    d->parentNames = settings.value(QLatin1String("Inherits")).toStringList();
-    QStringList subdirList = settings.value(QLatin1String("Directories")).toStringList();
-    settings.endGroup();
+    QString themeGroup(QLatin1String("Icon Theme"));
+    d->name = file.value(themeGroup, "Name");
+    d->localizedName = file.localizedValue(themeGroup, "Name");
+    d->example = file.value(themeGroup, "Example");
+    d->hidden = file.boolValue(themeGroup, "Hidden", false);
+    d->parentNames = file.listValue(themeGroup, "Inherits");
+    QStringList subdirList = file.listValue(themeGroup, "Directories");
 
-	QSet<QString> allDirs = settings.childGroups().toSet();
+	QSet<QString> allDirs = file.groups().toSet();
+	// Collected sorted by path, then stored in one array
+	QMap<QString, XdgIconDir> dirs;
     for (int i = 0; i < subdirList.size(); i++) {
         const QString &subdir = subdirList.at(i);
 		
-        XdgIconDir &dirdata = d->subdirs.insert(subdir, XdgIconDir()).value();
+        XdgIconDir &dirdata = dirs.insert(subdir, XdgIconDir()).value();
         dirdata.path = subdir;
-		dirdata.fill(settings);
+		dirdata.fill(file);
     }
+	// Remember what the theme was read from, so it can be restored from the manifest
+	d->stamps.insert(indexFileName, XdgIconScanner::dirStamp(indexFileName));
 	foreach (QDir basedir, basedirs) {
-		if (!basedir.cd(id))
+		if (!basedir.cd(id)) {
+			d->stamps.insert(basedir.absoluteFilePath(id), XdgIconIndex::MissingStamp);
 			continue;
+		}
+		d->stamps.insert(basedir.absolutePath(), XdgIconScanner::dirStamp(basedir.absolutePath()));
 		QDirIterator sizeIt(basedir.absolutePath(), QDir::Dirs | QDir::NoDotAndDotDot);
 		while (sizeIt.hasNext()) {
-			QDirIterator it(sizeIt.next(), QDir::Dirs | QDir::NoDotAndDotDot);
+			QString sizePath = sizeIt.next();
+			d->stamps.insert(sizePath, XdgIconScanner::dirStamp(sizePath));
+			QDirIterator it(sizePath, QDir::Dirs | QDir::NoDotAndDotDot);
 			QString size = sizeIt.fileName();
 			QScopedPointer<XdgIconDir> sizeDir;
 			while (it.hasNext()) {
 				QString path = basedir.relativeFilePath(it.next());
-				if (d->subdirs.contains(path))
+				if (dirs.contains(path))
 					continue;
 				if (!sizeDir && allDirs.contains(path)) {
 					sizeDir.reset(new XdgIconDir);
-					sizeDir->fill(settings);
+					sizeDir->path = path;
+					sizeDir->fill(file);
 				} else if (!sizeDir) {
 					if (size == QLatin1String("scalable")) {
 						sizeDir.reset(new XdgIconDir);
@@ -353,10 +596,11 @@ XdgIconTheme::XdgIconTheme(const QVector<QDir> &basedirs, const QString &id, Xdg
 					}
 				}
 				sizeDir->path = path;
-				d->subdirs.insert(path, *sizeDir);
+				dirs.insert(path, *sizeDir);
 			}
 		}
 	}
+	d->subdirs = dirs.values().toVector();
 }
 
 /**
@@ -388,6 +632,15 @@ QString XdgIconTheme::name() const
     return d_func()->name;
 }
 
+/**
+  Returns the theme name translated to the system language, or the same as
+  <code>name()</code> if the theme has no translation for it.
+*/
+QString XdgIconTheme::localizedName() const
+{
+    return d_func()->localizedName;
+}
+
 /**
   Returns the XDG name (e.g. "document-new") of the icon that is supposed to
   be an example of how the theme looks, or an empty string if the theme author
@@ -424,8 +677,19 @@ void XdgIconTheme::addParent(const XdgIconTheme *parent)
 {
     Q_D(XdgIconTheme);
     Q_ASSERT_X(parent, "XdgIconTheme::addParent", "Parent must be not null");
-    if (!d->parents.contains(parent))
+    if (!d->parents.contains(parent)) {
         d->parents.append(parent);
+        QMutexLocker locker(&d->mergedLock);
+        d->merged.store(0);
+    }
+}
+
+/**
+  Returns a handle for the icon, which remembers where it was found.
+*/
+XdgIconHandle XdgIconTheme::iconHandle(const QString &name) const
+{
+    return XdgIconHandle(name, manager(), this);
 }
 
 /**
@@ -438,7 +702,21 @@ QString XdgIconTheme::getIconPath(const QString &name, uint size) const
 {
     Q_D(const XdgIconTheme);
 
-    XdgIconData *data = d->findIcon(name);
-    const XdgIconEntry *entry = data ? data->findEntry(size) : 0;
-    return entry ? entry->path : QString();
+    XdgIconData data = d->findIcon(name);
+    int entry = data.isNull() ? -1 : data.findEntry(size);
+    return entry < 0 ? QString() : data.entryPath(entry);
+}
+
+/**
+  Returns the paths of many icons at once, in the order of the names, as
+  <code>getIconPath()</code> would for each of them. Missing icons get
+  empty strings. The whole batch is resolved against one snapshot of the
+  theme's indexes, repeated names are looked up once, and big batches are
+  spread over several threads.
+*/
+QStringList XdgIconTheme::getIconPaths(const QStringList &names, uint size) const
+{
+    Q_D(const XdgIconTheme);
+
+    return d->ensureMergedIndex()->merged.findPaths(names, size);
 }
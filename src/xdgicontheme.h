@@ -26,6 +26,7 @@
 #include <QtCore/QVector>
 #include "xdgexport.h"
 #include "xdgicon.h"
+#include "xdgiconhandle.h"
 
 class XdgIconThemePrivate;
 class XdgIconManager;
@@ -47,19 +48,22 @@ public:
 	XdgIconManager *manager() const;
     QString id() const;
     QString name() const;
+    QString localizedName() const;
     QString exampleName() const;
     bool hidden() const;
     QStringList parentIds() const;
 
     void addParent(const XdgIconTheme *parent);
     QString getIconPath(const QString &name, uint size = 22) const;
+    QStringList getIconPaths(const QStringList &names, uint size = 22) const;
+    XdgIconHandle iconHandle(const QString &name) const;
 
 #ifdef QT_GUI_LIB
     /**
       Returns an icon with the specified name (e.g. "document-new").
     */
     inline QIcon getIcon(const QString &iconName) const
-    { return XdgIcon(iconName, id(), manager()); }
+    { return XdgIcon(iconHandle(iconName)); }
 
     /**
       Convenience function.
@@ -20,9 +20,16 @@
 #define XDGICONTHEME_P_H
 
 #include "xdgicontheme.h"
+#include "xdgiconindex_p.h"
+#include "xdgiconsnapshot_p.h"
 #include <QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QQueue>
+#include <QtCore/QSet>
+#include <QtCore/QVarLengthArray>
 
-class QSettings;
+class XdgIconThemeFile;
+class QDataStream;
 
 /**
   @private
@@ -36,7 +43,7 @@ struct XdgIconDir
         Threshold = 2
 	};
 	XdgIconDir() : size(0), type(Threshold), maxsize(0), minsize(0), threshold(0) {}
-	void fill(QSettings &settings);
+	void fill(const XdgIconThemeFile &file);
 
     QString path;
     uint size;
@@ -46,63 +53,175 @@ struct XdgIconDir
     uint threshold;
 };
 
+QDataStream &operator<<(QDataStream &out, const XdgIconDir &dir);
+QDataStream &operator>>(QDataStream &in, XdgIconDir &dir);
+
 /**
   @private
+
+  Index of one theme, as published to lookups. It is never changed once
+  published, an update publishes a new one.
 */
-struct XdgIconEntry
+class XdgIconIndexSnapshot : public QSharedData
 {
-    inline XdgIconEntry() : dir(0) {}
-    XdgIconEntry(const XdgIconDir *d, const QString &p) : dir(d), path(p) {}
-    const XdgIconDir *dir;
-    QString path;
+public:
+	XdgIconIndex index;
+};
+
+typedef QExplicitlySharedDataPointer<XdgIconIndexSnapshot> XdgIconIndexRef;
+
+/**
+  @private
+
+  Merged index of an inheritance chain, together with the indexes it
+  points into and the manager generation it was built for.
+*/
+class XdgIconMergedSnapshot : public QSharedData
+{
+public:
+	XdgIconMergedSnapshot() : generation(0) {}
+	XdgIconMergedIndex merged;
+	QVector<XdgIconIndexRef> chain;
+	uint generation;
 };
 
 /**
   @private
+
+  Icon record of a theme index. This is a light view over the index image,
+  it keeps the index snapshot alive, so it stays valid after the theme's
+  index has been rebuilt.
 */
 class XdgIconData
 {
 public:
-    QList<XdgIconEntry> entries;
-    QStringRef name;
+	inline XdgIconData() : index(0), icon(-1) {}
+	inline XdgIconData(const XdgIconIndexRef &s, int n) : snapshot(s), index(&s->index), icon(n) {}
+	inline bool isNull() const { return icon < 0; }
+
+	inline QString name() const { return index->iconName(icon); }
+	inline int entryCount() const { return index->entryCount(icon); }
+	inline const XdgIconDir *entryDir(int entry) const { return index->entryDir(icon, entry); }
+	inline QString entryPath(int entry) const { return index->entryPath(icon, entry); }
+	inline int findEntry(uint size) const { return index->findEntry(icon, size); }
 
-    const XdgIconEntry *findEntry(uint size) const;
+	XdgIconIndexRef snapshot;
+	const XdgIconIndex *index;
+	int icon;
 };
 
+class XdgIconThemePrivate;
+
 /**
   @private
+
+  Themes already visited by a lookup. Inheritance chains are short, so a
+  linear search on the stack beats hashing.
 */
-typedef QHash<QStringRef, XdgIconData> XdgIconDataHash;
-typedef QMap<QString, XdgIconDir> XdgIconDirHash;
+typedef QVarLengthArray<const XdgIconThemePrivate *, 16> XdgIconThemeSet;
 
 /**
   @private
+
+  Lookups may run in any thread. The indexes are built once, on first use,
+  and published as snapshots; readers take the current snapshot without
+  locking. Building and updating is serialized by <code>indexLock</code>,
+  which is taken after the manager lock, and <code>mergedLock</code>,
+  which is taken before both and never while holding the manager lock.
 */
 class XdgIconThemePrivate
 {
 public:
+	XdgIconThemePrivate() : manager(0), hidden(false), missGeneration(0) {}
 	XdgIconManager *manager;
     QString id;
     QString name;
+    QString localizedName;
     QString example;
     bool hidden;
     QVector<QDir> basedirs;
     QStringList parentNames;
-    XdgIconDirHash subdirs;
+    XdgIconDirList subdirs;
     QVector<const XdgIconTheme *> parents;
-	mutable QString buffer;
-	mutable XdgIconDataHash icons;
-
-    XdgIconData *findIcon(const QString &name) const;
-    QString findIcon(const QString &name, uint size) const;
-    XdgIconData *lookupIconRecursive(const QString &name, QList<const XdgIconThemePrivate*> &themeSet) const;
-    XdgIconData *tryCache(const QString &name) const;
-    void saveToCache(const QString &originName, XdgIconData *data) const;
+	QMap<QString, quint32> stamps;
+	mutable XdgIconSnapshotSlot<XdgIconIndexSnapshot> index;
+	mutable XdgIconSnapshotSlot<XdgIconMergedSnapshot> merged;
+	mutable QMutex indexLock;
+	mutable QMutex mergedLock;
+	// The miss cache is only an optimization, it is skipped while another thread holds it
+	mutable QMutex missLock;
+	enum { maxMisses = 256 };
+	mutable QSet<QString> misses;
+	mutable QQueue<QString> missOrder;
+	mutable uint missGeneration;
+
+    XdgIconData findIcon(const QString &name) const;
+	void collectChain(XdgIconThemeSet &themeSet) const;
+	QExplicitlySharedDataPointer<XdgIconMergedSnapshot> ensureMergedIndex() const;
+	bool isMiss(const QString &name) const;
+	void addMiss(const QString &name, uint seenGeneration) const;
+	void clearMisses() const;
+	uint generation() const;
     QString lookupFallbackIcon(const QString &name) const;
     static bool dirMatchesSize(const XdgIconDir &dir, uint size);
     static uint dirSizeDistance(const XdgIconDir &dir, uint size);
-	void ensureDirectoryMapsHelper() const;
-	inline void ensureDirectoryMaps() const { if(icons.isEmpty()) ensureDirectoryMapsHelper(); }
+	XdgIconIndexRef ensureDirectoryMapsHelper() const;
+	bool updateIndex() const;
+	XdgIconIndexRef loadIndex() const;
+	XdgIconIndexRef rebuildIndex(XdgIconIndexRef old) const;
+	XdgIconIndexRef saveIndex(const XdgIconIndexBuilder &builder) const;
+	void publishIndex(const XdgIconIndexRef &snapshot) const;
+	QStringList cachePaths(const QString &suffix = QLatin1String(".index")) const;
+	void saveCache(const QString &suffix, const QByteArray &image) const;
+	static bool writeCache(const QString &path, const QByteArray &image);
+	bool saveSystemCaches() const;
+	QStringList watchPaths() const;
+	QByteArray saveRecord(const QString &indexFileName) const;
+	bool restoreRecord(const QByteArray &data, const QString &indexFileName);
+	inline XdgIconIndexRef ensureDirectoryMaps() const
+	{
+		XdgIconIndexRef current = index.load();
+		return current ? current : ensureDirectoryMapsHelper();
+	}
 };
 
+// Inline, the index calls them for every entry while building size tables
+inline bool XdgIconThemePrivate::dirMatchesSize(const XdgIconDir &dir, uint size)
+{
+    switch (dir.type) {
+    case XdgIconDir::Fixed:
+        return size == dir.size;
+    case XdgIconDir::Scalable:
+		return false;
+//        return (size >= dir.minsize) && (size <= dir.maxsize);
+    case XdgIconDir::Threshold:
+        return (size >= dir.size - dir.threshold) && (size <= dir.size + dir.threshold);
+    }
+    Q_ASSERT(!"New directory type?..");
+    return false;
+}
+
+inline uint XdgIconThemePrivate::dirSizeDistance(const XdgIconDir &dir, uint size)
+{
+    switch (dir.type) {
+    case XdgIconDir::Fixed:
+        return qAbs(int(dir.size) - int(size));
+    case XdgIconDir::Scalable:
+        if(size < dir.minsize)
+            return dir.minsize - size;
+        if(size > dir.maxsize)
+            return size - dir.maxsize;
+        return 0;
+    case XdgIconDir::Threshold:
+        if(size < dir.size - dir.threshold)
+            return dir.size - dir.threshold - size;
+        if(size > dir.size + dir.threshold)
+            return size - dir.size - dir.threshold;
+        return 0;
+    }
+
+    Q_ASSERT(!"New directory type?..");
+    return 0;
+}
+
 #endif // XDGICONTHEME_P_H
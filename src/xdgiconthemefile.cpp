@@ -0,0 +1,329 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <string.h>
+#include <QtCore/QLocale>
+#include <QtCore/QVarLengthArray>
+#include "xdgiconthemefile_p.h"
+
+namespace
+{
+	// Theme files are tiny, anything bigger is not worth mapping
+	const qint64 maxFileSize = 16 * 1024 * 1024;
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char *skipSpaces(const char *begin, const char *end)
+	{
+		while (begin < end && isSpace(*begin))
+			++begin;
+		return begin;
+	}
+
+	inline const char *chopSpaces(const char *begin, const char *end)
+	{
+		while (end > begin && isSpace(end[-1]))
+			--end;
+		return end;
+	}
+
+	QString unescape(const char *begin, const char *end)
+	{
+		QVarLengthArray<char, 128> buffer;
+		for (const char *p = begin; p < end; ++p) {
+			if (*p != '\\' || p + 1 == end) {
+				buffer.append(*p);
+				continue;
+			}
+			switch (*++p) {
+			case 's': buffer.append(' '); break;
+			case 'n': buffer.append('\n'); break;
+			case 't': buffer.append('\t'); break;
+			case 'r': buffer.append('\r'); break;
+			default: buffer.append(*p); break;
+			}
+		}
+		return QString::fromUtf8(buffer.constData(), buffer.size());
+	}
+}
+
+XdgIconThemeFile::XdgIconThemeFile() : m_data(0), m_size(0)
+{
+}
+
+XdgIconThemeFile::~XdgIconThemeFile()
+{
+	clear();
+}
+
+/**
+  Maps and scans the file. Lines which can not be parsed are skipped, like
+  other implementations of the specification do.
+*/
+bool XdgIconThemeFile::load(const QString &fileName)
+{
+	clear();
+	m_file.setFileName(fileName);
+	if (!m_file.open(QIODevice::ReadOnly))
+		return false;
+	qint64 size = m_file.size();
+	if (size > maxFileSize) {
+		clear();
+		return false;
+	}
+	if (size > 0) {
+		m_data = reinterpret_cast<const char *>(m_file.map(0, size));
+		if (!m_data) {
+			clear();
+			return false;
+		}
+		m_size = quint32(size);
+	}
+	parse();
+	return true;
+}
+
+void XdgIconThemeFile::clear()
+{
+	m_groupIndex.clear();
+	m_groups.clear();
+	if (m_data) {
+		m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_data)));
+		m_data = 0;
+	}
+	if (m_file.isOpen())
+		m_file.close();
+	m_size = 0;
+}
+
+/**
+  Returns the group names in the order of their first appearance.
+*/
+QStringList XdgIconThemeFile::groups() const
+{
+	QStringList result;
+	foreach (const Group &group, m_groups)
+		result << QString::fromUtf8(m_data + group.name, group.nameLength);
+	return result;
+}
+
+bool XdgIconThemeFile::contains(const QString &group, const char *key) const
+{
+	return findKey(findGroup(group), key) != 0;
+}
+
+QString XdgIconThemeFile::value(const QString &group, const char *key, const QString &defaultValue) const
+{
+	const Key *found = findKey(findGroup(group), key);
+	return found ? decode(found) : defaultValue;
+}
+
+/**
+  Returns the value translated for the locale, which defaults to the system
+  one. Like the specification says, <code>lang_COUNTRY@MODIFIER</code>,
+  <code>lang_COUNTRY</code>, <code>lang@MODIFIER</code> and <code>lang</code>
+  are tried in turn before the untranslated key.
+*/
+QString XdgIconThemeFile::localizedValue(const QString &group, const char *key, const QString &locale) const
+{
+	QByteArray name = (locale.isEmpty() ? QLocale::system().name() : locale).toLatin1();
+	QByteArray modifier;
+	int at = name.indexOf('@');
+	if (at >= 0) {
+		modifier = name.mid(at);
+		name.truncate(at);
+	}
+	int dot = name.indexOf('.');
+	if (dot >= 0)
+		name.truncate(dot);
+	QByteArray lang = name.left(name.indexOf('_'));
+
+	int index = findGroup(group);
+	QByteArray candidates[4] = { name + modifier, name, lang + modifier, lang };
+	const int count = sizeof(candidates) / sizeof(candidates[0]);
+	for (int i = 0; i < count; i++) {
+		if (candidates[i].isEmpty() || (i > 0 && candidates[i] == candidates[i - 1]))
+			continue;
+		if (const Key *found = findKey(index, key, candidates[i]))
+			return decode(found);
+	}
+	const Key *found = findKey(index, key);
+	return found ? decode(found) : QString();
+}
+
+/**
+  Returns a comma separated list. Items are trimmed and empty items are
+  dropped, so trailing commas do no harm.
+*/
+QStringList XdgIconThemeFile::listValue(const QString &group, const char *key) const
+{
+	QStringList result;
+	const Key *found = findKey(findGroup(group), key);
+	if (!found)
+		return result;
+	const char *p = m_data + found->value;
+	const char *end = p + found->valueLength;
+	const char *item = p;
+	for (; p <= end; ++p) {
+		if (p < end && *p == '\\') {
+			if (p + 1 < end)
+				++p;
+			continue;
+		}
+		if (p < end && *p != ',')
+			continue;
+		const char *itemBegin = skipSpaces(item, p);
+		const char *itemEnd = chopSpaces(itemBegin, qMin(p, end));
+		if (itemBegin < itemEnd)
+			result << unescape(itemBegin, itemEnd);
+		item = p + 1;
+	}
+	return result;
+}
+
+/**
+  Returns an unsigned number, or 0 if the value is not one.
+*/
+uint XdgIconThemeFile::uintValue(const QString &group, const char *key, uint defaultValue) const
+{
+	const Key *found = findKey(findGroup(group), key);
+	if (!found)
+		return defaultValue;
+	const char *p = m_data + found->value;
+	const char *end = p + found->valueLength;
+	if (p == end)
+		return 0;
+	quint64 result = 0;
+	for (; p < end; ++p) {
+		if (*p < '0' || *p > '9')
+			return 0;
+		result = result * 10 + (*p - '0');
+		if (result > 0xffffffffULL)
+			return 0;
+	}
+	return uint(result);
+}
+
+/**
+  Returns a boolean. As with <code>QVariant::toBool()</code>, everything
+  except an empty value, "0" and "false" is true.
+*/
+bool XdgIconThemeFile::boolValue(const QString &group, const char *key, bool defaultValue) const
+{
+	const Key *found = findKey(findGroup(group), key);
+	if (!found)
+		return defaultValue;
+	QByteArray value = QByteArray::fromRawData(m_data + found->value, found->valueLength).toLower();
+	return !value.isEmpty() && value != "0" && value != "false";
+}
+
+void XdgIconThemeFile::parse()
+{
+	const char *p = m_data;
+	const char *end = m_data + m_size;
+	int group = -1;
+	while (p < end) {
+		const char *lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+		if (!lineEnd)
+			lineEnd = end;
+		const char *begin = skipSpaces(p, lineEnd);
+		const char *last = chopSpaces(begin, lineEnd);
+		p = lineEnd + 1;
+		if (begin == last || *begin == '#' || *begin == ';')
+			continue;
+
+		if (*begin == '[') {
+			group = -1;
+			if (last[-1] != ']' || last - begin < 3)
+				continue;
+			QByteArray name = QByteArray::fromRawData(begin + 1, last - begin - 2);
+			QHash<QByteArray, int>::const_iterator it = m_groupIndex.constFind(name);
+			if (it != m_groupIndex.constEnd()) {
+				// Repeated groups are merged
+				group = it.value();
+				continue;
+			}
+			group = m_groups.size();
+			m_groups.resize(group + 1);
+			m_groups[group].name = quint32(begin + 1 - m_data);
+			m_groups[group].nameLength = quint32(name.size());
+			m_groupIndex.insert(name, group);
+			continue;
+		}
+
+		const char *eq = group < 0 ? 0 : static_cast<const char *>(memchr(begin, '=', last - begin));
+		if (!eq)
+			continue;
+		const char *nameEnd = chopSpaces(begin, eq);
+		const char *valueBegin = skipSpaces(eq + 1, last);
+		if (nameEnd == begin)
+			continue;
+		Key key;
+		key.name = quint32(begin - m_data);
+		key.nameLength = quint32(nameEnd - begin);
+		key.locale = 0;
+		key.localeLength = 0;
+		if (nameEnd[-1] == ']') {
+			const char *bracket = static_cast<const char *>(memchr(begin, '[', nameEnd - begin));
+			if (bracket) {
+				key.nameLength = quint32(bracket - begin);
+				key.locale = quint32(bracket + 1 - m_data);
+				key.localeLength = quint32(nameEnd - bracket - 2);
+			}
+		}
+		key.value = quint32(valueBegin - m_data);
+		key.valueLength = quint32(last - valueBegin);
+		m_groups[group].keys.append(key);
+	}
+}
+
+/*
+  Returns the index of the group, or -1. Public calls resolve the group
+  once and look up their keys by index, so the name is encoded only once.
+*/
+int XdgIconThemeFile::findGroup(const QString &group) const
+{
+	return m_groupIndex.value(group.toUtf8(), -1);
+}
+
+/*
+  Later keys override earlier ones, so the search goes backwards.
+*/
+const XdgIconThemeFile::Key *XdgIconThemeFile::findKey(int group, const char *key, const QByteArray &locale) const
+{
+	if (group < 0)
+		return 0;
+	const QVector<Key> &keys = m_groups.at(group).keys;
+	quint32 keyLength = quint32(strlen(key));
+	for (int i = keys.size() - 1; i >= 0; i--) {
+		const Key &k = keys.at(i);
+		if (k.nameLength == keyLength && k.localeLength == quint32(locale.size())
+		        && memcmp(m_data + k.name, key, keyLength) == 0
+		        && memcmp(m_data + k.locale, locale.constData(), locale.size()) == 0)
+			return &k;
+	}
+	return 0;
+}
+
+QString XdgIconThemeFile::decode(const Key *key) const
+{
+	return unescape(m_data + key->value, m_data + key->value + key->valueLength);
+}
@@ -0,0 +1,84 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef XDGICONTHEMEFILE_P_H
+#define XDGICONTHEMEFILE_P_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+/**
+  @private
+
+  Reader for <code>index.theme</code> files. Only the key file subset used
+  by the icon theme specification is supported: groups, <code>key=value</code>
+  lines, comments, localized <code>key[locale]</code> keys, comma separated
+  lists and the <code>\\s \\n \\t \\r \\\\</code> escapes.
+
+  The file is memory-mapped and scanned once. Groups and keys are kept as
+  offsets into the mapping, values are decoded only when asked for.
+*/
+class XdgIconThemeFile
+{
+	Q_DISABLE_COPY(XdgIconThemeFile)
+public:
+	XdgIconThemeFile();
+	~XdgIconThemeFile();
+
+	bool load(const QString &fileName);
+	void clear();
+
+	QStringList groups() const;
+	bool contains(const QString &group, const char *key) const;
+	QString value(const QString &group, const char *key, const QString &defaultValue = QString()) const;
+	QString localizedValue(const QString &group, const char *key, const QString &locale = QString()) const;
+	QStringList listValue(const QString &group, const char *key) const;
+	uint uintValue(const QString &group, const char *key, uint defaultValue) const;
+	bool boolValue(const QString &group, const char *key, bool defaultValue) const;
+
+private:
+	struct Key
+	{
+		quint32 name;
+		quint32 nameLength;
+		quint32 locale;
+		quint32 localeLength;
+		quint32 value;
+		quint32 valueLength;
+	};
+	struct Group
+	{
+		quint32 name;
+		quint32 nameLength;
+		QVector<Key> keys;
+	};
+	void parse();
+	int findGroup(const QString &group) const;
+	const Key *findKey(int group, const char *key, const QByteArray &locale = QByteArray()) const;
+	QString decode(const Key *key) const;
+	QFile m_file;
+	const char *m_data;
+	quint32 m_size;
+	QVector<Group> m_groups;
+	QHash<QByteArray, int> m_groupIndex;
+};
+
+#endif // XDGICONTHEMEFILE_P_H
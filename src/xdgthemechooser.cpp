@@ -19,72 +19,200 @@
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QProcess>
-#include <QtCore/QSettings>
+#include <QtCore/QStringList>
 #include <QtCore/QTextStream>
+#include <QtCore/QXmlStreamReader>
+#include "xdgenvironment.h"
 #include "xdgthemechooser.h"
+#include "xdgthemechooser_p.h"
+#include "xdgiconthemefile_p.h"
 
 namespace {
-    QString getGtkTheme(const QString& commandLine, const QString& fallback)
+    // A settings tool which is not done by then is hung
+    const int toolTimeout = 500;
+
+    QString gtk3Settings()
     {
-        QString themeName;
+        return XdgEnvironment::configHome().absoluteFilePath(QLatin1String("gtk-3.0/settings.ini"));
+    }
 
-        QProcess process;
-        process.start(commandLine, QIODevice::ReadOnly);
+    QString gtkrc()
+    {
+        return QDir::home().absoluteFilePath(QLatin1String(".gtkrc-2.0"));
+    }
 
-        if (process.waitForStarted()) {
-            QTextStream stream(&process);
+    QString gconfInterface()
+    {
+        return QDir::home().absoluteFilePath(QLatin1String(".gconf/desktop/gnome/interface/%gconf.xml"));
+    }
 
-            while (process.waitForReadyRead())
-                themeName += stream.readAll();
+    QString xfconfSettings()
+    {
+        return XdgEnvironment::configHome().absoluteFilePath(
+                QLatin1String("xfce4/xfconf/xfce-perchannel-xml/xsettings.xml"));
+    }
 
-            themeName = themeName.trimmed();
-            process.close();
-            return themeName;
+    QStringList kdeGlobals()
+    {
+        QStringList files;
+        QByteArray env = qgetenv("KDEHOME");
+        if (!env.isEmpty()) {
+            files << QDir(QString::fromLocal8Bit(env, env.size())).absoluteFilePath(QLatin1String("share/config/kdeglobals"));
+        } else {
+            // We should try both ~/.kde and ~/.kde4
+            files << QDir::home().absoluteFilePath(QLatin1String(".kde/share/config/kdeglobals"));
+            files << QDir::home().absoluteFilePath(QLatin1String(".kde4/share/config/kdeglobals"));
         }
+        return files;
+    }
 
-        // Attempt to read gtkrc
-        QFile file(QDir::home().absoluteFilePath(QLatin1String(".gtkrc-2.0")));
+    // Key files: GTK+ 3 settings.ini and kdeglobals
+    QString readKeyFile(const QString &fileName, const QString &group, const char *key)
+    {
+        XdgIconThemeFile file;
+        if (!file.load(fileName))
+            return QString();
+        return file.value(group, key).trimmed();
+    }
 
-        if (file.exists()) {
-            file.open(QIODevice::ReadOnly);
-            QTextStream stream(&file);
-            QRegExp exp(QLatin1String("^\\s*gtk-icon-theme-name\\s*=(.*)"));
-            QString str;
+    QString readGtkrc(const QString &fileName)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return QString();
+
+        QTextStream stream(&file);
+        QRegExp exp(QLatin1String("^\\s*gtk-icon-theme-name\\s*=(.*)"));
+
+        while (!stream.atEnd()) {
+            QString str = stream.readLine();
+            if (exp.indexIn(str) == -1)
+                continue;
+
+            QString themeName = exp.cap(1).trimmed();
+            if ((themeName.startsWith('"') && themeName.endsWith('"'))
+                || (themeName.startsWith('\'') && themeName.endsWith('\''))) {
+                themeName = themeName.mid(1, themeName.length() - 2).trimmed();
+            }
+            return themeName;
+        }
 
-            while (!(str = stream.readLine()).isEmpty()) {
-                if (exp.indexIn(str) != -1) {
-                    themeName = exp.cap(1).trimmed();
+        return QString();
+    }
 
-                    if ((themeName.startsWith('"') && themeName.endsWith('"'))
-                        || (themeName.startsWith('\'') && themeName.endsWith('\''))) {
-                        themeName = themeName.mid(1, themeName.length() - 2).trimmed();
-                    }
+    // <entry name="icon_theme" type="string"><stringvalue>...</stringvalue></entry>
+    QString readGconf(const QString &fileName, const QString &entry)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return QString();
+
+        QXmlStreamReader xml(&file);
+        bool inEntry = false;
+        while (!xml.atEnd()) {
+            xml.readNext();
+            if (xml.isStartElement()) {
+                if (xml.name() == QLatin1String("entry"))
+                    inEntry = xml.attributes().value(QLatin1String("name")) == entry;
+                else if (inEntry && xml.name() == QLatin1String("stringvalue"))
+                    return xml.readElementText().trimmed();
+            } else if (xml.isEndElement() && xml.name() == QLatin1String("entry")) {
+                inEntry = false;
+            }
+        }
+        return QString();
+    }
 
-                    return themeName;
-                }
+    // Nested <property name="..." value="..."/> elements, the path is like "Net/IconThemeName"
+    QString readXfconf(const QString &fileName, const QString &path)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return QString();
+
+        QXmlStreamReader xml(&file);
+        QStringList current;
+        while (!xml.atEnd()) {
+            xml.readNext();
+            if (xml.isStartElement() && xml.name() == QLatin1String("property")) {
+                current << xml.attributes().value(QLatin1String("name")).toString();
+                if (current.join(QLatin1String("/")) == path)
+                    return xml.attributes().value(QLatin1String("value")).toString().trimmed();
+            } else if (xml.isEndElement() && xml.name() == QLatin1String("property") && !current.isEmpty()) {
+                current.removeLast();
             }
         }
+        return QString();
+    }
 
-        return fallback;
+    /*
+      Last resort when the settings are not in the files we know about. The
+      tool is killed if it does not finish in time.
+    */
+    QString runTool(const QString &program, const QStringList &arguments)
+    {
+        QProcess process;
+        process.start(program, arguments, QIODevice::ReadOnly);
+
+        if (!process.waitForFinished(toolTimeout)) {
+            process.kill();
+            process.waitForFinished(toolTimeout);
+            return QString();
+        }
+        if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+            return QString();
+        return QString::fromLocal8Bit(process.readAllStandardOutput()).trimmed();
     }
 }
 
+/**
+  @private
+
+  Returns the configuration files the theme choosers read, whether they
+  exist or not. Changes of these files may change the default theme.
+*/
+QStringList xdgThemeConfigFiles()
+{
+    QStringList files;
+    files << gtk3Settings() << gconfInterface() << gtkrc() << xfconfSettings() << kdeGlobals();
+    return files;
+}
+
 /**
   Returns the user's chosen icon theme in the GNOME desktop environment.
+  The settings files are read directly, <code>gconftool-2</code> is only
+  asked if none of them has the theme.
 */
 QString xdgGetGnomeTheme()
 {
-    return getGtkTheme(QLatin1String("gconftool-2 -g /desktop/gnome/interface/icon_theme"),
-                       QLatin1String("gnome"));
+    QString themeName = readKeyFile(gtk3Settings(), QLatin1String("Settings"), "gtk-icon-theme-name");
+    if (themeName.isEmpty())
+        themeName = readGconf(gconfInterface(), QLatin1String("icon_theme"));
+    if (themeName.isEmpty())
+        themeName = readGtkrc(gtkrc());
+    if (themeName.isEmpty()) {
+        themeName = runTool(QLatin1String("gconftool-2"),
+                            QStringList() << QLatin1String("-g") << QLatin1String("/desktop/gnome/interface/icon_theme"));
+    }
+    return themeName.isEmpty() ? QLatin1String("gnome") : themeName;
 }
 
 /**
   Returns the user's chosen icon theme in the Xfce desktop environment.
+  The xsettings channel is read directly, <code>xfconf-query</code> is only
+  asked if the file does not have the theme.
 */
 QString xdgGetXfceTheme()
 {
-    return getGtkTheme(QLatin1String("xfconf-query -c xsettings -p /Net/IconThemeName"),
-                       QLatin1String("Tango"));
+    QString themeName = readXfconf(xfconfSettings(), QLatin1String("Net/IconThemeName"));
+    if (themeName.isEmpty()) {
+        themeName = runTool(QLatin1String("xfconf-query"),
+                            QStringList() << QLatin1String("-c") << QLatin1String("xsettings")
+                                          << QLatin1String("-p") << QLatin1String("/Net/IconThemeName"));
+    }
+    if (themeName.isEmpty())
+        themeName = readGtkrc(gtkrc());
+    return themeName.isEmpty() ? QLatin1String("Tango") : themeName;
 }
 
 /**
@@ -92,8 +220,6 @@ QString xdgGetXfceTheme()
 */
 QString xdgGetKdeTheme()
 {
-    QDir kdeHome;
-
     int version = QString::fromLocal8Bit(qgetenv("KDE_SESSION_VERSION")).toInt();
     QString fallback;
     if (version >= 4)
@@ -101,27 +227,11 @@ QString xdgGetKdeTheme()
     else
         fallback = QLatin1String("crystalsvg");
 
-    {
-        QByteArray env = qgetenv("KDEHOME");
-
-        if (env.isEmpty()) {
-            kdeHome = QDir::home();
-            // We should try both ~/.kde and ~/.kde4
-            if (!(kdeHome.cd(QLatin1String(".kde")) || kdeHome.cd(QLatin1String(".kde4"))))
-                return fallback;
-        }
-        else {
-            kdeHome = QString::fromLocal8Bit(env, env.size());
-        }
-    }
-
-    if (kdeHome.exists()) {
-        QString config = kdeHome.absoluteFilePath(QLatin1String("share/config/kdeglobals"));
-
-        if (QFile::exists(config)) {
-            QSettings settings(config, QSettings::IniFormat);
-            return settings.value(QLatin1String("Icons/Theme"), fallback).toString();
-        }
+    foreach (const QString &config, kdeGlobals()) {
+        if (!QFile::exists(config))
+            continue;
+        QString themeName = readKeyFile(config, QLatin1String("Icons"), "Theme");
+        return themeName.isEmpty() ? fallback : themeName;
     }
 
     return fallback;
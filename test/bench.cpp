@@ -0,0 +1,257 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Microbenchmarks of the icon index on synthetic themes
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QTime>
+#include <QtCore/QVarLengthArray>
+#include "../src/xdgiconindex_p.h"
+#include "../src/xdgicontheme_p.h"
+
+namespace
+{
+	int failures = 0;
+
+	// The usual layout of a big theme: fixed sizes, threshold sizes and scalable
+	XdgIconDirList makeDirs()
+	{
+		QMap<QString, XdgIconDir> dirs;
+		const uint sizes[] = { 8, 16, 22, 24, 32, 36, 48, 64, 72, 96, 128, 192, 256, 512 };
+		for (uint i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+			XdgIconDir dir;
+			dir.path = QString::fromLatin1("%1x%1/apps").arg(sizes[i]);
+			dir.size = dir.minsize = dir.maxsize = sizes[i];
+			dir.type = i % 2 ? XdgIconDir::Fixed : XdgIconDir::Threshold;
+			dir.threshold = 2;
+			dirs.insert(dir.path, dir);
+		}
+		XdgIconDir scalable;
+		scalable.path = QLatin1String("scalable/apps");
+		scalable.size = 128;
+		scalable.minsize = 1;
+		scalable.maxsize = 256;
+		scalable.type = XdgIconDir::Scalable;
+		dirs.insert(scalable.path, scalable);
+		return dirs.values().toVector();
+	}
+
+	QString iconName(int i)
+	{
+		return QString::fromLatin1("synthetic-icon-%1").arg(i);
+	}
+
+	// Returns the size of the image
+	int buildIndex(XdgIconIndex &index, const XdgIconDirList &dirs, int iconCount)
+	{
+		QStringList themeDirs(QLatin1String("/usr/share/icons/synthetic"));
+		XdgIconIndexBuilder builder(dirs, themeDirs);
+		for (int i = 0; i < iconCount; i++) {
+			QString name = iconName(i);
+			foreach (const XdgIconDir &dir, dirs) {
+				builder.addEntry(name, 0, &dir,
+				                 QLatin1String("/usr/share/icons/synthetic/") + dir.path + QLatin1Char('/') + name + QLatin1String(".png"));
+			}
+		}
+		QByteArray image = builder.build();
+		index.load(image);
+		if (!index.attach(dirs, themeDirs)) {
+			qWarning("Can't attach the synthetic index");
+			failures++;
+		}
+		return image.size();
+	}
+
+	// What XdgIconData::findEntry() did before the size tables
+	inline int scanEntries(const XdgIconIndex &index, int icon, uint size)
+	{
+		int count = index.entryCount(icon);
+		QVarLengthArray<const XdgIconDir *, 32> dirs(count);
+		for (int i = 0; i < count; i++)
+			dirs[i] = index.entryDir(icon, i);
+		return XdgIconIndex::selectEntry(dirs.constData(), count, size);
+	}
+
+	void benchSizeSelection()
+	{
+		const int iconCount = 2000;
+		const uint sizes[] = { 16, 22, 24, 32, 48, 64, 128, 20, 40, 300 };
+		const int sizeCount = sizeof(sizes) / sizeof(sizes[0]);
+		XdgIconDirList dirs = makeDirs();
+		XdgIconIndex index;
+		buildIndex(index, dirs, iconCount);
+
+		for (int icon = 0; icon < index.iconCount(); icon += 97) {
+			for (uint size = 0; size <= 1024; size++) {
+				if (index.findEntry(icon, size) != scanEntries(index, icon, size)) {
+					qWarning("Size table of %s differs at %u", qPrintable(index.iconName(icon)), size);
+					failures++;
+				}
+			}
+		}
+
+		const int rounds = 50;
+		int checksum = 0;
+		QTime timer;
+		timer.start();
+		for (int r = 0; r < rounds; r++) {
+			for (int icon = 0; icon < iconCount; icon++)
+				checksum += scanEntries(index, icon, sizes[(icon + r) % sizeCount]);
+		}
+		int scanTime = timer.restart();
+		for (int r = 0; r < rounds; r++) {
+			for (int icon = 0; icon < iconCount; icon++)
+				checksum -= index.findEntry(icon, sizes[(icon + r) % sizeCount]);
+		}
+		int tableTime = timer.elapsed();
+		if (checksum != 0)
+			failures++;
+
+		qDebug() << "Size selection," << rounds * iconCount << "lookups over" << dirs.size() << "dirs:"
+		         << "scan" << scanTime << "ms, table" << tableTime << "ms";
+	}
+
+	void benchIndexSize()
+	{
+		const int iconCount = 50000;
+		XdgIconDirList dirs = makeDirs();
+		XdgIconIndex index;
+		int size = buildIndex(index, dirs, iconCount);
+		QString name = iconName(iconCount - 1);
+		QString expected = QLatin1String("/usr/share/icons/synthetic/scalable/apps/") + name + QLatin1String(".png");
+		int icon = index.findIcon(QStringRef(&name));
+		if (icon < 0 || index.entryPath(icon, index.entryCount(icon) - 1) != expected) {
+			qWarning("Paths are not rebuilt correctly");
+			failures++;
+		}
+		qDebug() << "Index of" << iconCount << "icons in" << dirs.size() << "dirs:" << size / 1024 << "KiB,"
+		         << double(size) / (iconCount * dirs.size()) << "bytes per entry";
+	}
+
+	// Hits and misses through the perfect hash, with QHash as the baseline
+	void benchLookup(int iconCount)
+	{
+		XdgIconDirList dirs = makeDirs();
+		dirs.resize(1);
+		XdgIconIndex index;
+		buildIndex(index, dirs, iconCount);
+		QHash<QString, int> hash;
+		QStringList hits, misses;
+		for (int i = 0; i < iconCount; i++) {
+			hits << iconName(i);
+			misses << QString::fromLatin1("missing-icon-%1").arg(i);
+			hash.insert(hits.last(), i);
+		}
+
+		for (int i = 0; i < iconCount; i++) {
+			int icon = index.findIcon(QStringRef(&hits.at(i)));
+			if (icon < 0 || index.iconName(icon) != hits.at(i) || index.findIcon(QStringRef(&misses.at(i))) >= 0) {
+				qWarning("Lookup of %s is broken", qPrintable(hits.at(i)));
+				failures++;
+				return;
+			}
+		}
+
+		const int lookups = qMax(iconCount, 1000000);
+		int found = 0;
+		QTime timer;
+		timer.start();
+		for (int i = 0; i < lookups; i++)
+			found += index.findIcon(QStringRef(&hits.at(i % iconCount))) >= 0;
+		int hitTime = timer.restart();
+		for (int i = 0; i < lookups; i++)
+			found -= index.findIcon(QStringRef(&misses.at(i % iconCount))) < 0;
+		int missTime = timer.restart();
+		for (int i = 0; i < lookups; i++)
+			found += hash.contains(hits.at(i % iconCount));
+		for (int i = 0; i < lookups; i++)
+			found -= !hash.contains(misses.at(i % iconCount));
+		int hashTime = timer.elapsed();
+		if (found != 0)
+			failures++;
+
+		qDebug() << "Lookup in" << iconCount << "icons:"
+		         << "hit" << hitTime * 1e6 / lookups << "ns, miss" << missTime * 1e6 / lookups << "ns,"
+		         << "QHash hit+miss" << hashTime * 1e6 / (2 * lookups) << "ns";
+	}
+
+	/*
+	  A batch of names as a file manager would resolve them: distinct ones,
+	  then the same count with many repeats, each with some misses. The
+	  batch has to give the same paths as the loop of single lookups.
+	*/
+	void benchBatchPaths(int nameCount)
+	{
+		XdgIconDirList dirs = makeDirs();
+		XdgIconIndex index;
+		buildIndex(index, dirs, nameCount);
+		QVector<const XdgIconIndex *> chain(1, &index);
+		XdgIconMergedIndex merged;
+		merged.load(XdgIconMergedIndex::build(chain));
+		if (!merged.attach(chain)) {
+			qWarning("Can't attach the merged index");
+			failures++;
+			return;
+		}
+
+		const int rounds = 10;
+		const int distinctCounts[] = { nameCount, nameCount / 20 };
+		for (int run = 0; run < 2; run++) {
+			QStringList names;
+			for (int i = 0; i < nameCount; i++) {
+				int n = (i * 7919) % distinctCounts[run];
+				names << (n % 10 ? iconName(n) : QString::fromLatin1("missing-icon-%1").arg(n));
+			}
+
+			QTime timer;
+			timer.start();
+			QStringList single;
+			for (int round = 0; round < rounds; round++) {
+				single.clear();
+				foreach (const QString &name, names)
+					single << merged.findPath(QStringRef(&name), 48);
+			}
+			int singleTime = timer.restart();
+			QStringList batch;
+			for (int round = 0; round < rounds; round++)
+				batch = merged.findPaths(names, 48);
+			int batchTime = timer.elapsed();
+			if (batch != single) {
+				qWarning("Batch paths differ from single lookups");
+				failures++;
+			}
+
+			qDebug() << "Paths of" << nameCount << "names," << distinctCounts[run] << "distinct:"
+			         << "single" << singleTime * 1000.0 / rounds << "us, batch" << batchTime * 1000.0 / rounds << "us";
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	benchSizeSelection();
+	benchIndexSize();
+	benchLookup(1000);
+	benchLookup(10000);
+	benchLookup(100000);
+	benchBatchPaths(10000);
+	return failures ? 1 : 0;
+}
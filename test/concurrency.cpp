@@ -0,0 +1,245 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+// Resolves icons from many threads while the theme index is rebuilt
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFile>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include "../src/xdgiconmanager.h"
+#include "../src/xdgiconsnapshot_p.h"
+
+namespace
+{
+	const int iconCount = 500;
+	const int threadCount = 8;
+	const int rounds = 5;
+	const int snapshotStores = 200000;
+	QAtomicInt failures;
+	QAtomicInt stop;
+
+	QString iconName(int i)
+	{
+		return QString::fromLatin1("stress-icon-%1").arg(i);
+	}
+
+	bool touch(const QString &fileName)
+	{
+		QFile file(fileName);
+		return file.open(QIODevice::WriteOnly);
+	}
+
+	void removeTree(const QString &path)
+	{
+		QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+		while (it.hasNext())
+			QFile::remove(it.next());
+		QStringList dirs;
+		QDirIterator dirIt(path, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+		while (dirIt.hasNext())
+			dirs.prepend(dirIt.next());
+		foreach (const QString &dir, dirs)
+			QDir().rmdir(dir);
+		QDir().rmdir(path);
+	}
+
+	/*
+	  Icons of the initial set have to be found all the time, the index
+	  being swapped under the lookup must not matter.
+	*/
+	class Resolver : public QThread
+	{
+	public:
+		Resolver(const XdgIconTheme *theme, int seed) : m_theme(theme), m_seed(seed), lookups(0) {}
+
+		void run()
+		{
+			uint state = m_seed;
+			while (stop == 0) {
+				state = state * 1103515245 + 12345;
+				QString name = iconName((state >> 8) % iconCount);
+				XdgIconHandle handle = m_theme->iconHandle(name);
+				if (m_theme->getIconPath(name, 22).isEmpty() || handle.iconPath(16).isEmpty()
+				        || !m_theme->getIconPath(QLatin1String("missing-") + name).isEmpty()) {
+					qWarning("%s was not resolved", qPrintable(name));
+					failures.ref();
+				}
+				lookups++;
+			}
+		}
+
+	private:
+		const XdgIconTheme *m_theme;
+		int m_seed;
+	public:
+		int lookups;
+	};
+
+	/*
+	  A snapshot overwrites its marker when it is deleted, so a reader
+	  holding a deleted one sees it, or the address sanitizer does.
+	*/
+	struct Snapshot : public QSharedData
+	{
+		enum { Alive = 0x51c0ffee, Dead = 0xdeadbeef };
+		Snapshot() : marker(Alive) { live.ref(); }
+		~Snapshot() { marker = Dead; live.deref(); }
+		volatile uint marker;
+		static QAtomicInt live;
+	};
+	QAtomicInt Snapshot::live;
+
+	/*
+	  Takes snapshots as fast as possible while the main thread replaces
+	  them back to back, and checks each one before and after a yield.
+	*/
+	class SnapshotReader : public QThread
+	{
+	public:
+		SnapshotReader(const XdgIconSnapshotSlot<Snapshot> *slot) : m_slot(slot) {}
+
+		void run()
+		{
+			uint count = 0;
+			while (stop == 0) {
+				QExplicitlySharedDataPointer<Snapshot> snapshot = m_slot->load();
+				if (!snapshot || snapshot->marker != Snapshot::Alive) {
+					failures.ref();
+					continue;
+				}
+				if ((++count & 63) == 0)
+					yieldCurrentThread();
+				if (snapshot->marker != Snapshot::Alive)
+					failures.ref();
+			}
+		}
+
+	private:
+		const XdgIconSnapshotSlot<Snapshot> *m_slot;
+	};
+
+	void raceSnapshots()
+	{
+		{
+			XdgIconSnapshotSlot<Snapshot> slot;
+			slot.store(new Snapshot);
+			QList<SnapshotReader *> readers;
+			for (int i = 0; i < threadCount; i++) {
+				readers << new SnapshotReader(&slot);
+				readers.last()->start();
+			}
+			for (int i = 0; i < snapshotStores; i++)
+				slot.store(new Snapshot);
+			stop = 1;
+			foreach (SnapshotReader *reader, readers)
+				reader->wait();
+			qDeleteAll(readers);
+			stop = 0;
+		}
+		if (Snapshot::live != 0) {
+			qWarning("%d snapshots were leaked", int(Snapshot::live));
+			failures.ref();
+		}
+		qDebug() << snapshotStores << "snapshot swaps," << int(failures) << "failures";
+	}
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	// Readers taking the slot's snapshot race with writers replacing it
+	raceSnapshots();
+
+	QDir root(QDir::temp().absoluteFilePath(QString::fromLatin1("qxdg-concurrency-%1").arg(QCoreApplication::applicationPid())));
+	removeTree(root.absolutePath());
+	// Keep the caches away from the user's ones
+	qputenv("XDG_DATA_HOME", QFile::encodeName(root.absoluteFilePath(QLatin1String("home"))));
+	qputenv("XDG_CACHE_HOME", QFile::encodeName(root.absoluteFilePath(QLatin1String("home/cache"))));
+
+	QString themePath = root.absoluteFilePath(QLatin1String("share/icons/stress"));
+	QStringList dirs;
+	dirs << QLatin1String("16x16/apps") << QLatin1String("22x22/apps");
+	foreach (const QString &dir, dirs)
+		root.mkpath(themePath + QLatin1Char('/') + dir);
+	root.mkpath(root.absoluteFilePath(QLatin1String("home")));
+	QFile index(themePath + QLatin1String("/index.theme"));
+	if (!index.open(QIODevice::WriteOnly)) {
+		qWarning("Can't write %s", qPrintable(index.fileName()));
+		return 1;
+	}
+	index.write("[Icon Theme]\nName=Stress\nDirectories=16x16/apps,22x22/apps\n\n"
+	            "[16x16/apps]\nSize=16\nType=Fixed\n\n[22x22/apps]\nSize=22\nType=Fixed\n");
+	index.close();
+	for (int i = 0; i < iconCount; i++) {
+		foreach (const QString &dir, dirs)
+			touch(themePath + QLatin1Char('/') + dir + QLatin1Char('/') + iconName(i) + QLatin1String(".png"));
+	}
+
+	XdgIconManager manager(QList<QDir>() << QDir(root.absoluteFilePath(QLatin1String("share"))));
+	const XdgIconTheme *theme = manager.themeById(QLatin1String("stress"));
+	if (!theme) {
+		qWarning("The stress theme was not found");
+		removeTree(root.absolutePath());
+		return 1;
+	}
+	manager.setWatching(true);
+
+	// The first lookups race for building the index as well
+	QList<Resolver *> threads;
+	for (int i = 0; i < threadCount; i++) {
+		threads << new Resolver(theme, i + 1);
+		threads.last()->start();
+	}
+
+	for (int round = 0; round < rounds; round++) {
+		// Stamps have a resolution of a second
+		QEventLoop pause;
+		QTimer::singleShot(1100, &pause, SLOT(quit()));
+		pause.exec();
+		QString added = QString::fromLatin1("added-icon-%1").arg(round);
+		touch(themePath + QLatin1String("/22x22/apps/") + added + QLatin1String(".png"));
+		QEventLoop loop;
+		QObject::connect(&manager, SIGNAL(changed()), &loop, SLOT(quit()));
+		QTimer::singleShot(10000, &loop, SLOT(quit()));
+		loop.exec();
+		if (theme->getIconPath(added).isEmpty()) {
+			qWarning("%s was not picked up", qPrintable(added));
+			failures.ref();
+		}
+	}
+
+	stop = 1;
+	int lookups = 0;
+	foreach (Resolver *thread, threads) {
+		thread->wait();
+		lookups += thread->lookups;
+	}
+	qDeleteAll(threads);
+	manager.setWatching(false);
+	removeTree(root.absolutePath());
+
+	qDebug() << lookups << "lookups in" << threadCount << "threads over" << rounds << "rebuilds," << int(failures) << "failures";
+	return failures != 0 ? 1 : 0;
+}
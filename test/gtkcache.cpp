@@ -0,0 +1,210 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+// Checks that themes with an icon-theme.cache are indexed like GTK+ sees them
+
+#include <utime.h>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QtEndian>
+#include "../src/xdgiconmanager.h"
+
+namespace
+{
+	int failures = 0;
+
+	struct CacheIcon
+	{
+		const char *name;
+		quint16 dir;
+		quint16 flags;
+	};
+
+	void check(bool ok, const char *what)
+	{
+		if (!ok) {
+			qWarning("%s", what);
+			failures++;
+		}
+	}
+
+	void putCard16(QByteArray &data, quint16 value)
+	{
+		uchar buffer[2];
+		qToBigEndian(value, buffer);
+		data.append(reinterpret_cast<const char *>(buffer), 2);
+	}
+
+	void putCard32(QByteArray &data, quint32 value)
+	{
+		uchar buffer[4];
+		qToBigEndian(value, buffer);
+		data.append(reinterpret_cast<const char *>(buffer), 4);
+	}
+
+	/*
+	  Writes a cache as gtk-update-icon-cache does, with all icons in one
+	  hash bucket and one image each.
+	*/
+	bool writeGtkCache(const QString &fileName, const QStringList &dirs, const CacheIcon *icons, int iconCount)
+	{
+		const quint32 hashOffset = 12;
+		const quint32 iconOffset = hashOffset + 8;
+		const quint32 imageOffset = iconOffset + iconCount * 12;
+		const quint32 dirListOffset = imageOffset + iconCount * 12;
+		quint32 stringOffset = dirListOffset + 4 + dirs.size() * 4;
+		QByteArray strings;
+
+		QByteArray data;
+		putCard16(data, 1);
+		putCard16(data, 0);
+		putCard32(data, hashOffset);
+		putCard32(data, dirListOffset);
+		putCard32(data, 1);
+		putCard32(data, iconCount ? iconOffset : 0xffffffff);
+		for (int i = 0; i < iconCount; i++) {
+			putCard32(data, i + 1 < iconCount ? iconOffset + (i + 1) * 12 : 0xffffffff);
+			putCard32(data, stringOffset + strings.size());
+			putCard32(data, imageOffset + i * 12);
+			strings.append(icons[i].name).append('\0');
+		}
+		for (int i = 0; i < iconCount; i++) {
+			putCard32(data, 1);
+			putCard16(data, icons[i].dir);
+			putCard16(data, icons[i].flags);
+			putCard32(data, 0);
+		}
+		putCard32(data, dirs.size());
+		foreach (const QString &dir, dirs) {
+			putCard32(data, stringOffset + strings.size());
+			strings.append(dir.toUtf8()).append('\0');
+		}
+		data.append(strings);
+
+		QFile file(fileName);
+		return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+	}
+
+	bool touch(const QString &fileName)
+	{
+		QFile file(fileName);
+		return file.open(QIODevice::WriteOnly);
+	}
+
+	// Stamps have a resolution of a second, so times are set explicitly
+	void setTime(const QString &path, uint time)
+	{
+		struct utimbuf times;
+		times.actime = time;
+		times.modtime = time;
+		utime(QFile::encodeName(path).constData(), &times);
+	}
+
+	void removeTree(const QString &path)
+	{
+		QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+		while (it.hasNext())
+			QFile::remove(it.next());
+		QStringList dirs;
+		QDirIterator dirIt(path, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+		while (dirIt.hasNext())
+			dirs.prepend(dirIt.next());
+		foreach (const QString &dir, dirs)
+			QDir().rmdir(dir);
+		QDir().rmdir(path);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	QDir root(QDir::temp().absoluteFilePath(QString::fromLatin1("qxdg-gtkcache-%1").arg(QCoreApplication::applicationPid())));
+	removeTree(root.absolutePath());
+	// Keep the caches away from the user's ones
+	qputenv("XDG_DATA_HOME", QFile::encodeName(root.absoluteFilePath(QLatin1String("home"))));
+	qputenv("XDG_CACHE_HOME", QFile::encodeName(root.absoluteFilePath(QLatin1String("home/cache"))));
+	root.mkpath(root.absoluteFilePath(QLatin1String("home")));
+
+	QString themePath = root.absoluteFilePath(QLatin1String("share/icons/cached"));
+	QStringList dirs;
+	dirs << QLatin1String("48x48/apps") << QLatin1String("scalable/apps");
+	foreach (const QString &dir, dirs)
+		root.mkpath(themePath + QLatin1Char('/') + dir);
+	QFile index(themePath + QLatin1String("/index.theme"));
+	if (!index.open(QIODevice::WriteOnly)) {
+		qWarning("Can't write %s", qPrintable(index.fileName()));
+		return 1;
+	}
+	index.write("[Icon Theme]\nName=Cached\nDirectories=48x48/apps,scalable/apps\n\n"
+	            "[48x48/apps]\nSize=48\nType=Fixed\n\n"
+	            "[scalable/apps]\nSize=48\nMinSize=8\nMaxSize=512\nType=Scalable\n");
+	index.close();
+
+	touch(themePath + QLatin1String("/48x48/apps/cached-png.png"));
+	touch(themePath + QLatin1String("/scalable/apps/cached-svg.svg"));
+	// Not in the cache, as gtk-update-icon-cache has no flag for it
+	touch(themePath + QLatin1String("/scalable/apps/compressed.svgz"));
+	const CacheIcon icons[] = {
+		{ "cached-png", 0, 4 },
+		{ "cached-svg", 1, 2 }
+	};
+	writeGtkCache(themePath + QLatin1String("/icon-theme.cache"), dirs, icons, 2);
+	// Installed later without updating the cache, only its dir changes
+	touch(themePath + QLatin1String("/48x48/apps/added.png"));
+
+	// The same theme without a cache is walked
+	QString plainPath = root.absoluteFilePath(QLatin1String("share/icons/plain"));
+	root.mkpath(plainPath + QLatin1String("/scalable/apps"));
+	QFile::copy(index.fileName(), plainPath + QLatin1String("/index.theme"));
+	touch(plainPath + QLatin1String("/scalable/apps/compressed.svgz"));
+
+	uint now = QDateTime::currentDateTime().toTime_t();
+	setTime(themePath, now - 100);
+	setTime(themePath + QLatin1String("/48x48"), now - 100);
+	setTime(themePath + QLatin1String("/scalable"), now - 100);
+	setTime(themePath + QLatin1String("/scalable/apps"), now - 100);
+	setTime(themePath + QLatin1String("/icon-theme.cache"), now - 50);
+	setTime(themePath + QLatin1String("/48x48/apps"), now - 10);
+
+	{
+		XdgIconManager manager(QList<QDir>() << QDir(root.absoluteFilePath(QLatin1String("share"))));
+		const XdgIconTheme *theme = manager.themeById(QLatin1String("cached"));
+		check(theme, "The cached theme was not found");
+		if (theme) {
+			check(!theme->getIconPath(QLatin1String("cached-png"), 48).isEmpty(), "cached-png was not found");
+			check(!theme->getIconPath(QLatin1String("cached-svg"), 48).isEmpty(), "cached-svg was not found");
+			check(!theme->getIconPath(QLatin1String("added"), 48).isEmpty(),
+			      "added was not found in a dir newer than the cache");
+			check(!theme->getIconPath(QLatin1String("compressed"), 48).isEmpty(),
+			      "compressed was not found next to the cache");
+		}
+		theme = manager.themeById(QLatin1String("plain"));
+		check(theme, "The plain theme was not found");
+		if (theme)
+			check(!theme->getIconPath(QLatin1String("compressed"), 48).isEmpty(), "compressed was not found without a cache");
+	}
+
+	removeTree(root.absolutePath());
+	qDebug() << "GTK+ cache checks:" << failures << "failures";
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+// Builds a system cache right after installing a theme and checks it is used
+
+#include <utime.h>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include "../src/xdgiconmanager.h"
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool ok, const char *what)
+	{
+		if (!ok) {
+			qWarning("%s", what);
+			failures++;
+		}
+	}
+
+	bool touch(const QString &fileName)
+	{
+		QFile file(fileName);
+		return file.open(QIODevice::WriteOnly);
+	}
+
+	void removeTree(const QString &path)
+	{
+		QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+		while (it.hasNext())
+			QFile::remove(it.next());
+		QStringList dirs;
+		QDirIterator dirIt(path, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+		while (dirIt.hasNext())
+			dirs.prepend(dirIt.next());
+		foreach (const QString &dir, dirs)
+			QDir().rmdir(dir);
+		QDir().rmdir(path);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	QDir root(QDir::temp().absoluteFilePath(QString::fromLatin1("qxdg-systemcache-%1").arg(QCoreApplication::applicationPid())));
+	removeTree(root.absolutePath());
+	// Keep the caches away from the user's ones
+	qputenv("XDG_DATA_HOME", QFile::encodeName(root.absoluteFilePath(QLatin1String("home"))));
+	qputenv("XDG_CACHE_HOME", QFile::encodeName(root.absoluteFilePath(QLatin1String("home/cache"))));
+	root.mkpath(root.absoluteFilePath(QLatin1String("home")));
+
+	// Like a package unpacking the theme and running its post-install hook
+	QString share = root.absoluteFilePath(QLatin1String("share"));
+	QString themePath = root.absoluteFilePath(QLatin1String("share/icons/packaged"));
+	QString appsPath = themePath + QLatin1String("/48x48/apps");
+	root.mkpath(appsPath);
+	QFile index(themePath + QLatin1String("/index.theme"));
+	if (!index.open(QIODevice::WriteOnly)) {
+		qWarning("Can't write %s", qPrintable(index.fileName()));
+		return 1;
+	}
+	index.write("[Icon Theme]\nName=Packaged\nDirectories=48x48/apps\n\n"
+	            "[48x48/apps]\nSize=48\nType=Fixed\n");
+	index.close();
+	touch(appsPath + QLatin1String("/listed.png"));
+	{
+		XdgIconManager manager(QList<QDir>() << QDir(share));
+		check(manager.updateCache(QLatin1String("packaged"), XdgIconManager::SystemCache),
+		      "The system cache was not written");
+	}
+	check(QFile::exists(root.absoluteFilePath(QLatin1String("share/icons/packaged.qxdg-index"))),
+	      "The system cache is missing");
+
+	// An icon only a scan would find, the stamp of its dir is put back
+	struct utimbuf times;
+	times.actime = times.modtime = QFileInfo(appsPath).lastModified().toTime_t();
+	touch(appsPath + QLatin1String("/unlisted.png"));
+	utime(QFile::encodeName(appsPath).constData(), &times);
+
+	{
+		XdgIconManager manager(QList<QDir>() << QDir(share));
+		const XdgIconTheme *theme = manager.themeById(QLatin1String("packaged"));
+		check(theme, "The packaged theme was not found");
+		if (theme) {
+			check(!theme->getIconPath(QLatin1String("listed"), 48).isEmpty(), "listed was not found");
+			check(theme->getIconPath(QLatin1String("unlisted"), 48).isEmpty(),
+			      "unlisted was found, the theme was scanned instead of using the system cache");
+		}
+	}
+
+	removeTree(root.absolutePath());
+	qDebug() << "System cache checks:" << failures << "failures";
+	return failures ? 1 : 0;
+}
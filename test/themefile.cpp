@@ -0,0 +1,159 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Checks XdgIconThemeFile against QSettings on the installed themes
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QSettings>
+#include <QtCore/QVariant>
+#include "../src/xdgenvironment.h"
+#include "../src/xdgiconthemefile_p.h"
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool ok, const QString &fileName, const QString &what)
+	{
+		if (!ok) {
+			qWarning("%s: %s differs", qPrintable(fileName), qPrintable(what));
+			failures++;
+		}
+	}
+
+	// QSettings keeps empty list items, the parser drops them
+	QStringList settingsList(const QSettings &settings, const QString &key)
+	{
+		QStringList list = settings.value(key).toStringList();
+		list.removeAll(QString());
+		return list;
+	}
+
+	void compareFile(const QString &fileName)
+	{
+		QSettings settings(fileName, QSettings::IniFormat);
+		XdgIconThemeFile file;
+		check(file.load(fileName), fileName, QLatin1String("load"));
+		QString theme(QLatin1String("Icon Theme"));
+
+		// QSettings splits values with commas, such names can not be compared
+		const char *stringKeys[] = { "Name", "Example" };
+		for (int i = 0; i < 2; i++) {
+			QVariant value = settings.value(theme + QLatin1Char('/') + QLatin1String(stringKeys[i]));
+			if (value.type() == QVariant::String)
+				check(value.toString() == file.value(theme, stringKeys[i]), fileName, QLatin1String(stringKeys[i]));
+		}
+		check(settings.value(theme + QLatin1String("/Hidden"), false).toBool() == file.boolValue(theme, "Hidden", false),
+		      fileName, QLatin1String("Hidden"));
+		check(settingsList(settings, theme + QLatin1String("/Inherits")) == file.listValue(theme, "Inherits"),
+		      fileName, QLatin1String("Inherits"));
+		QStringList dirs = settingsList(settings, theme + QLatin1String("/Directories"));
+		check(dirs == file.listValue(theme, "Directories"), fileName, QLatin1String("Directories"));
+
+		foreach (const QString &dir, dirs) {
+			settings.beginGroup(dir);
+			uint size = settings.value(QLatin1String("Size")).toUInt();
+			check(size == file.uintValue(dir, "Size", 0), fileName, dir + QLatin1String("/Size"));
+			check(settings.value(QLatin1String("MaxSize"), size).toUInt() == file.uintValue(dir, "MaxSize", size),
+			      fileName, dir + QLatin1String("/MaxSize"));
+			check(settings.value(QLatin1String("MinSize"), size).toUInt() == file.uintValue(dir, "MinSize", size),
+			      fileName, dir + QLatin1String("/MinSize"));
+			check(settings.value(QLatin1String("Threshold"), 2).toUInt() == file.uintValue(dir, "Threshold", 2),
+			      fileName, dir + QLatin1String("/Threshold"));
+			QString type = settings.value(QLatin1String("Type"), QLatin1String("Threshold")).toString();
+			check(type == file.value(dir, "Type", QLatin1String("Threshold")), fileName, dir + QLatin1String("/Type"));
+			settings.endGroup();
+		}
+	}
+
+	void checkSyntax()
+	{
+		QString fileName = QDir::temp().absoluteFilePath(QLatin1String("qxdg-themefile-test.theme"));
+		QFile out(fileName);
+		if (!out.open(QIODevice::WriteOnly)) {
+			qWarning("Can't write %s", qPrintable(fileName));
+			failures++;
+			return;
+		}
+		out.write("# comment\n"
+		          "[Icon Theme]\n"
+		          "Name = Test\n"
+		          "Name[de]=Prüfung\n"
+		          "Name[sr@latin]=Proba\n"
+		          "Comment=First\\sline\\nsecond\n"
+		          "Directories=16x16/apps, 22x22/apps,\n"
+		          "Hidden=true\r\n"
+		          "\n"
+		          "[16x16/apps]\n"
+		          "Size=16\n"
+		          "Size=17\n"
+		          "[22x22/apps]\n"
+		          "Size=22\n"
+		          "Type=Fixed\n"
+		          "MinSize=abc\n");
+		out.close();
+
+		XdgIconThemeFile file;
+		QString theme(QLatin1String("Icon Theme"));
+		check(file.load(fileName), fileName, QLatin1String("load"));
+		check(file.value(theme, "Name") == QLatin1String("Test"), fileName, QLatin1String("Name"));
+		check(file.localizedValue(theme, "Name", QLatin1String("de_DE")) == QString::fromUtf8("Prüfung"),
+		      fileName, QLatin1String("Name[de]"));
+		check(file.localizedValue(theme, "Name", QLatin1String("sr_RS@latin")) == QLatin1String("Proba"),
+		      fileName, QLatin1String("Name[sr@latin]"));
+		check(file.localizedValue(theme, "Name", QLatin1String("fr_FR")) == QLatin1String("Test"),
+		      fileName, QLatin1String("Name[fr]"));
+		check(file.value(theme, "Comment") == QLatin1String("First line\nsecond"), fileName, QLatin1String("Comment"));
+		check(file.listValue(theme, "Directories") == QStringList() << QLatin1String("16x16/apps") << QLatin1String("22x22/apps"),
+		      fileName, QLatin1String("Directories"));
+		check(file.boolValue(theme, "Hidden", false), fileName, QLatin1String("Hidden"));
+		check(file.uintValue(QLatin1String("16x16/apps"), "Size", 0) == 17, fileName, QLatin1String("Size"));
+		check(file.uintValue(QLatin1String("22x22/apps"), "MinSize", 22) == 0, fileName, QLatin1String("MinSize"));
+		check(file.value(QLatin1String("22x22/apps"), "Type") == QLatin1String("Fixed"), fileName, QLatin1String("Type"));
+		check(!file.contains(QLatin1String("32x32/apps"), "Size"), fileName, QLatin1String("missing group"));
+		file.clear();
+		QFile::remove(fileName);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	checkSyntax();
+
+	QList<QDir> dirs = XdgEnvironment::dataDirs();
+	dirs.prepend(XdgEnvironment::dataHome());
+	int count = 0;
+	foreach (QDir dir, dirs) {
+		if (!dir.cd(QLatin1String("icons")))
+			continue;
+		foreach (const QString &theme, dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+			QString fileName = dir.absoluteFilePath(theme + QLatin1String("/index.theme"));
+			if (QFile::exists(fileName)) {
+				compareFile(fileName);
+				count++;
+			}
+		}
+	}
+
+	qDebug() << "Compared" << count << "themes," << failures << "failures";
+	return failures ? 1 : 0;
+}
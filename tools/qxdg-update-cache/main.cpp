@@ -0,0 +1,77 @@
+/*
+    Copyright © 2009 Ruslan Nigmatullin <euroelessar@yandex.ru>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+// Builds q-xdg icon caches ahead of time, for package post-install hooks
+
+#include <stdio.h>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include "../../src/xdgiconmanager.h"
+
+namespace
+{
+	void usage()
+	{
+		fprintf(stderr,
+		        "Usage: qxdg-update-cache [--system] [theme-id...]\n"
+		        "Builds the icon caches of the given themes, or of all installed themes.\n"
+		        "\n"
+		        "  --system  write caches next to the themes, which are read by all users\n"
+		        "            (needs write access to the icon directories)\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	XdgIconManager::CacheLocation location = XdgIconManager::UserCache;
+	QStringList ids;
+	QStringList args = app.arguments();
+	for (int i = 1; i < args.size(); i++) {
+		const QString &arg = args.at(i);
+		if (arg == QLatin1String("--system")) {
+			location = XdgIconManager::SystemCache;
+		} else if (arg == QLatin1String("--help") || arg == QLatin1String("-h")) {
+			usage();
+			return 0;
+		} else if (arg.startsWith(QLatin1Char('-'))) {
+			usage();
+			return 2;
+		} else {
+			ids << arg;
+		}
+	}
+
+	XdgIconManager manager;
+	bool all = ids.isEmpty();
+	if (all)
+		ids = manager.themeIds(true);
+
+	int failures = 0;
+	foreach (const QString &id, ids) {
+		if (manager.updateCache(id, location))
+			continue;
+		// Themes without icons of their own have nothing to write
+		if (!all || location == XdgIconManager::UserCache) {
+			fprintf(stderr, "qxdg-update-cache: can't update the cache of %s\n", qPrintable(id));
+			failures++;
+		}
+	}
+	return failures ? 1 : 0;
+}